@@ -0,0 +1,794 @@
+#include "circuit.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "mul.h"
+#include "pool.h"
+
+
+#define CIRCUIT_MIN_CAPACITY 16
+
+static inline uint32_t gate_hash(GateType type, gate_id_t a, gate_id_t b) {
+    uint64_t h = ((uint64_t)a << 32 | b) * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(h >> 32) ^ (uint32_t)type;
+}
+
+// Slot of the gate (type, a, b) in the table, or of the empty slot where it would go
+static uint32_t table_slot(Circuit* c, GateType type, gate_id_t a, gate_id_t b) {
+    uint32_t mask = c->table_size - 1;
+    for (uint32_t s = gate_hash(type, a, b) & mask;; s = (s + 1) & mask) {
+        uint32_t entry = c->table[s];
+        if (entry == 0) return s;
+        Gate g = c->gates[entry - 1];
+        if (g.type == type && g.a == a && g.b == b) return s;
+    }
+}
+
+static void table_rebuild(Circuit* c, uint32_t table_size) {
+    free(c->table);
+    c->table_size = table_size;
+    c->table = (uint32_t*) calloc(table_size, sizeof(uint32_t));
+    if (c->table == NULL) exit(1);
+    for (gate_id_t id = 0; id < c->n_gates; id++) {
+        Gate g = c->gates[id];
+        if (g.type != GATE_XOR && g.type != GATE_AND) continue;
+        uint32_t s = table_slot(c, g.type, g.a, g.b);
+        if (c->table[s] == 0) c->table[s] = id + 1;
+    }
+}
+
+static gate_id_t append_gate(Circuit* c, Gate g) {
+    if (c->n_gates == c->capacity) {
+        c->capacity *= 2;
+        c->gates = (Gate*) realloc(c->gates, c->capacity*sizeof(Gate));
+        if (c->gates == NULL) exit(1);
+    }
+    c->gates[c->n_gates] = g;
+    return c->n_gates++;
+}
+
+// XOR or AND gate of operands a <= b, unless the same one exists already
+static gate_id_t add_gate(Circuit* c, GateType type, gate_id_t a, gate_id_t b) {
+    uint32_t s = table_slot(c, type, a, b);
+    if (c->table[s] != 0) return c->table[s] - 1;
+    uint32_t level = MAX(c->gates[a].level, c->gates[b].level) + (type == GATE_AND);
+    gate_id_t id = append_gate(c, (Gate){type, a, b, level});
+    c->table[s] = id + 1;
+    // Half full at most, so that probes stay short
+    if (2*(uint64_t)c->n_gates > c->table_size) table_rebuild(c, 2*c->table_size);
+    return id;
+}
+
+static inline void check_gate(Circuit* c, gate_id_t g) {
+    if (g >= c->n_gates) exit(1);
+}
+
+
+void circuit_init(Circuit* c) {
+    if (c == NULL) exit(1);
+    *c = (Circuit){0};
+    c->capacity = CIRCUIT_MIN_CAPACITY;
+    c->gates = (Gate*) malloc(c->capacity*sizeof(Gate));
+    c->outputs_capacity = CIRCUIT_MIN_CAPACITY;
+    c->outputs = (gate_id_t*) malloc(c->outputs_capacity*sizeof(gate_id_t));
+    if (c->gates == NULL || c->outputs == NULL) exit(1);
+    append_gate(c, (Gate){GATE_CONSTANT, false, 0, 0});
+    append_gate(c, (Gate){GATE_CONSTANT, true, 0, 0});
+    table_rebuild(c, 4*CIRCUIT_MIN_CAPACITY);
+}
+
+void circuit_clear(Circuit c) {
+    free(c.gates);
+    free(c.table);
+    free(c.outputs);
+}
+
+gate_id_t circuit_input(Circuit* c) {
+    return append_gate(c, (Gate){GATE_INPUT, c->n_inputs++, 0, 0});
+}
+
+gate_id_t circuit_xor(Circuit* c, gate_id_t a, gate_id_t b) {
+    check_gate(c, a);
+    check_gate(c, b);
+    if (a > b) {
+        gate_id_t tmp = a;
+        a = b;
+        b = tmp;
+    }
+    // The constants have the lowest ids, so only a can be one
+    if (a == b) return CIRCUIT_FALSE;
+    if (a == CIRCUIT_FALSE) return b;
+    // a + (a + x) = x, which also removes double negations
+    Gate gb = c->gates[b];
+    if (gb.type == GATE_XOR && (gb.a == a || gb.b == a)) return gb.a == a ? gb.b : gb.a;
+    Gate ga = c->gates[a];
+    if (ga.type == GATE_XOR && (ga.a == b || ga.b == b)) return ga.a == b ? ga.b : ga.a;
+    return add_gate(c, GATE_XOR, a, b);
+}
+
+gate_id_t circuit_and(Circuit* c, gate_id_t a, gate_id_t b) {
+    check_gate(c, a);
+    check_gate(c, b);
+    if (a > b) {
+        gate_id_t tmp = a;
+        a = b;
+        b = tmp;
+    }
+    // a*a decrypts to a with a lower degree
+    if (a == b) return a;
+    if (a == CIRCUIT_FALSE) return CIRCUIT_FALSE;
+    if (a == CIRCUIT_TRUE) return b;
+    return add_gate(c, GATE_AND, a, b);
+}
+
+gate_id_t circuit_not(Circuit* c, gate_id_t a) {
+    return circuit_xor(c, a, CIRCUIT_TRUE);
+}
+
+gate_id_t circuit_or(Circuit* c, gate_id_t a, gate_id_t b) {
+    return circuit_xor(c, circuit_xor(c, a, b), circuit_and(c, a, b));
+}
+
+void circuit_output(Circuit* c, gate_id_t g) {
+    check_gate(c, g);
+    if (c->n_outputs == c->outputs_capacity) {
+        c->outputs_capacity *= 2;
+        c->outputs = (gate_id_t*) realloc(c->outputs, c->outputs_capacity*sizeof(gate_id_t));
+        if (c->outputs == NULL) exit(1);
+    }
+    c->outputs[c->n_outputs++] = g;
+}
+
+void circuit_add(Circuit* c, const gate_id_t* a, const gate_id_t* b, uint32_t width, gate_id_t* sum) {
+    gate_id_t* g = (gate_id_t*) malloc(2*MAX(width, 1)*sizeof(gate_id_t));
+    if (g == NULL) exit(1);
+    gate_id_t* p = g + width;
+    for (uint32_t i = 0; i < width; i++) {
+        g[i] = circuit_and(c, a[i], b[i]);
+        p[i] = circuit_xor(c, a[i], b[i]);
+        sum[i] = p[i];
+    }
+
+    // Same prefix as brent_kung_add: G = G_high + P_high*G_low, the two terms being exclusive
+    // The gates nobody reads, such as the last P of each level, are dropped by circuit_evaluate
+    uint32_t dist = 1;
+    for (; 2*(uint64_t)dist <= width; dist *= 2) {
+        for (uint64_t i = 2*dist-1; i < width; i += 2*dist) {
+            g[i] = circuit_xor(c, g[i], circuit_and(c, p[i], g[i-dist]));
+            p[i] = circuit_and(c, p[i], p[i-dist]);
+        }
+    }
+    for (dist /= 2; dist >= 1; dist /= 2) {
+        for (uint64_t i = 3*(uint64_t)dist-1; i < width; i += 2*dist) {
+            g[i] = circuit_xor(c, g[i], circuit_and(c, p[i], g[i-dist]));
+        }
+    }
+
+    for (uint32_t i = 1; i < width; i++) sum[i] = circuit_xor(c, sum[i], g[i-1]);
+    free(g);
+}
+
+
+static inline bool is_operation(Gate g) {
+    return g.type == GATE_XOR || g.type == GATE_AND;
+}
+
+typedef struct {
+    gate_id_t gate;
+    uint8_t next;
+} DfsFrame;
+
+// Writes the gates the outputs depend on to order, each one after its operands, and returns their number
+static uint32_t live_gates(Circuit c, gate_id_t* order) {
+    uint8_t* seen = (uint8_t*) calloc(c.n_gates, 1);
+    DfsFrame* stack = (DfsFrame*) malloc(MAX(c.n_gates, 1)*sizeof(DfsFrame));
+    if (seen == NULL || stack == NULL) exit(1);
+    uint32_t count = 0;
+    for (uint32_t o = 0; o < c.n_outputs; o++) {
+        if (seen[c.outputs[o]]) continue;
+        seen[c.outputs[o]] = 1;
+        uint32_t depth = 0;
+        stack[depth++] = (DfsFrame){c.outputs[o], 0};
+        while (depth > 0) {
+            DfsFrame* f = &stack[depth-1];
+            Gate g = c.gates[f->gate];
+            if (is_operation(g) && f->next < 2) {
+                gate_id_t operand = f->next++ == 0 ? g.a : g.b;
+                if (!seen[operand]) {
+                    seen[operand] = 1;
+                    stack[depth++] = (DfsFrame){operand, 0};
+                }
+                continue;
+            }
+            order[count++] = f->gate;
+            depth--;
+        }
+    }
+    free(stack);
+    free(seen);
+    return count;
+}
+
+// Readers of each gate, the outputs included
+static uint32_t* count_uses(Circuit c, const gate_id_t* order, uint32_t n_live) {
+    uint32_t* uses = (uint32_t*) calloc(MAX(c.n_gates, 1), sizeof(uint32_t));
+    if (uses == NULL) exit(1);
+    for (uint32_t k = 0; k < n_live; k++) {
+        Gate g = c.gates[order[k]];
+        if (!is_operation(g)) continue;
+        uses[g.a]++;
+        uses[g.b]++;
+    }
+    for (uint32_t o = 0; o < c.n_outputs; o++) uses[c.outputs[o]]++;
+    return uses;
+}
+
+typedef struct {
+    gate_id_t gate;
+    uint32_t level;
+} Leaf;
+
+static int compare_leaves(const void* x, const void* y) {
+    uint32_t lx = ((const Leaf*) x)->level;
+    uint32_t ly = ((const Leaf*) y)->level;
+    return (lx > ly) - (lx < ly);
+}
+
+// Rebuilds the AND tree of root, whose inner gates are the absorbed ones, from its lowest leaves up
+static void rebalance_and(Circuit* c, gate_id_t root, const bool* absorbed, Leaf* leaves, gate_id_t* stack) {
+    uint32_t n_leaves = 0;
+    uint32_t depth = 0;
+    stack[depth++] = c->gates[root].a;
+    stack[depth++] = c->gates[root].b;
+    while (depth > 0) {
+        gate_id_t g = stack[--depth];
+        if (absorbed[g]) {
+            stack[depth++] = c->gates[g].a;
+            stack[depth++] = c->gates[g].b;
+        } else leaves[n_leaves++] = (Leaf){g, c->gates[g].level};
+    }
+    if (n_leaves <= 2) return;
+
+    // Huffman-like: the two lowest leaves are multiplied, and their product goes back in order
+    qsort(leaves, n_leaves, sizeof(Leaf), compare_leaves);
+    uint32_t first = 0;
+    while (n_leaves - first > 2) {
+        gate_id_t g = circuit_and(c, leaves[first].gate, leaves[first+1].gate);
+        Leaf product = {g, c->gates[g].level};
+        first++;
+        uint32_t k = first + 1;
+        for (; k < n_leaves && leaves[k].level < product.level; k++) leaves[k-1] = leaves[k];
+        leaves[k-1] = product;
+    }
+    Gate* r = &c->gates[root];
+    r->a = MIN(leaves[first].gate, leaves[first+1].gate);
+    r->b = MAX(leaves[first].gate, leaves[first+1].gate);
+}
+
+void circuit_optimize(Circuit* c) {
+    uint32_t n = c->n_gates;
+    gate_id_t* order = (gate_id_t*) malloc(MAX(n, 1)*sizeof(gate_id_t));
+    if (order == NULL) exit(1);
+    uint32_t n_live = live_gates(*c, order);
+    uint32_t* uses = count_uses(*c, order, n_live);
+
+    // An AND read once by another AND is part of the tree of the latter
+    bool* absorbed = (bool*) calloc(n, sizeof(bool));
+    Leaf* leaves = (Leaf*) malloc(MAX(n, 1)*sizeof(Leaf));
+    gate_id_t* stack = (gate_id_t*) malloc(2*MAX(n, 1)*sizeof(gate_id_t));
+    if (absorbed == NULL || leaves == NULL || stack == NULL) exit(1);
+    for (uint32_t k = 0; k < n_live; k++) {
+        Gate g = c->gates[order[k]];
+        if (g.type != GATE_AND) continue;
+        if (c->gates[g.a].type == GATE_AND && uses[g.a] == 1) absorbed[g.a] = true;
+        if (c->gates[g.b].type == GATE_AND && uses[g.b] == 1) absorbed[g.b] = true;
+    }
+
+    // In order, so that the levels of the operands are final when a gate is reached
+    for (uint32_t k = 0; k < n_live; k++) {
+        gate_id_t id = order[k];
+        if (absorbed[id] || !is_operation(c->gates[id])) continue;
+        if (c->gates[id].type == GATE_AND) rebalance_and(c, id, absorbed, leaves, stack);
+        Gate* g = &c->gates[id];
+        g->level = MAX(c->gates[g->a].level, c->gates[g->b].level) + (g->type == GATE_AND);
+    }
+
+    // The roots changed operands
+    table_rebuild(c, c->table_size);
+    free(stack);
+    free(leaves);
+    free(absorbed);
+    free(uses);
+    free(order);
+}
+
+uint32_t circuit_depth(Circuit c) {
+    uint32_t depth = 0;
+    for (uint32_t o = 0; o < c.n_outputs; o++) depth = MAX(depth, c.gates[c.outputs[o]].level);
+    return depth;
+}
+
+
+// Gates ready to run: the owner pushes and pops at the bottom, the others steal from the top
+// A gate is pushed once, so the array never has to wrap
+typedef struct {
+    pthread_mutex_t lock;
+    gate_id_t* gates;
+    uint32_t top;
+    uint32_t bottom;
+} GateDeque;
+
+static bool deque_pop(GateDeque* q, gate_id_t* g) {
+    pthread_mutex_lock(&q->lock);
+    bool found = q->bottom > q->top;
+    if (found) *g = q->gates[--q->bottom];
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+static bool deque_steal(GateDeque* q, gate_id_t* g) {
+    pthread_mutex_lock(&q->lock);
+    bool found = q->bottom > q->top;
+    if (found) *g = q->gates[q->top++];
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+typedef struct {
+    const Gate* gates;
+    Polynomial_t* values;
+    // Operands not computed yet, and readers not done yet
+    atomic_uint* pending;
+    atomic_uint* remaining;
+    uint32_t* first_reader;
+    gate_id_t* readers;
+    // Computed here and never given to the caller, and read once by a XOR
+    bool* owned;
+    bool* reusable;
+    GateDeque* deques;
+    uint32_t n_threads;
+    atomic_uint left;
+    // Gates pushed and not taken yet, and the idle workers waiting for one
+    atomic_uint queued;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle;
+} Evaluation;
+
+static void deque_push(Evaluation* e, GateDeque* q, gate_id_t g) {
+    // Counted first, so that queued never drops below the gates in the deques
+    atomic_fetch_add(&e->queued, 1);
+    pthread_mutex_lock(&q->lock);
+    q->gates[q->bottom++] = g;
+    pthread_mutex_unlock(&q->lock);
+    // Under the lock, so that a worker about to wait either sees the gate or gets the signal
+    pthread_mutex_lock(&e->idle_lock);
+    pthread_cond_signal(&e->idle);
+    pthread_mutex_unlock(&e->idle_lock);
+}
+
+// Blocks until a gate is queued or all of them are done
+static void wait_for_gate(Evaluation* e) {
+    pthread_mutex_lock(&e->idle_lock);
+    while (atomic_load(&e->queued) == 0 && atomic_load(&e->left) > 0) pthread_cond_wait(&e->idle, &e->idle_lock);
+    pthread_mutex_unlock(&e->idle_lock);
+}
+
+typedef struct {
+    Evaluation* e;
+    uint32_t t;
+} Worker;
+
+static void release_value(Evaluation* e, gate_id_t g) {
+    if (e->owned[g] && atomic_fetch_sub(&e->remaining[g], 1) == 1) delete_polynom(e->values[g]);
+}
+
+static void evaluate_gate(Evaluation* e, gate_id_t id) {
+    Gate g = e->gates[id];
+    Polynomial_t x = e->values[g.a];
+    Polynomial_t y = e->values[g.b];
+    Polynomial_t r = {0};
+    gate_id_t reused = CIRCUIT_FALSE;
+    if (g.type == GATE_XOR) {
+        // Accumulating into the buffer of the operand merges the chains of XOR
+        if (e->reusable[g.a]) {
+            r = x;
+            reused = g.a;
+            xor_into(&r, y);
+        } else if (e->reusable[g.b]) {
+            r = y;
+            reused = g.b;
+            xor_into(&r, x);
+        } else {
+            // The larger operand first, so that r is allocated once
+            xor_into(&r, x.degree >= y.degree ? x : y);
+            xor_into(&r, x.degree >= y.degree ? y : x);
+        }
+    } else mul_add_into(&r, x, y);
+    e->values[id] = r;
+    if (reused != g.a) release_value(e, g.a);
+    if (reused != g.b) release_value(e, g.b);
+}
+
+static void* evaluation_worker(void* arg) {
+    Worker* w = (Worker*) arg;
+    Evaluation* e = w->e;
+    GateDeque* own = &e->deques[w->t];
+    while (atomic_load(&e->left) > 0) {
+        gate_id_t g;
+        bool found = deque_pop(own, &g);
+        for (uint32_t k = 1; !found && k < e->n_threads; k++) found = deque_steal(&e->deques[(w->t + k) % e->n_threads], &g);
+        if (!found) {
+            wait_for_gate(e);
+            continue;
+        }
+        atomic_fetch_sub(&e->queued, 1);
+        evaluate_gate(e, g);
+        for (uint32_t k = e->first_reader[g]; k < e->first_reader[g+1]; k++) {
+            if (atomic_fetch_sub(&e->pending[e->readers[k]], 1) == 1) deque_push(e, own, e->readers[k]);
+        }
+        if (atomic_fetch_sub(&e->left, 1) == 1) {
+            // The last gate releases the workers still waiting
+            pthread_mutex_lock(&e->idle_lock);
+            pthread_cond_broadcast(&e->idle);
+            pthread_mutex_unlock(&e->idle_lock);
+        }
+    }
+    if (w->t > 0) pol_pool_trim();
+    return NULL;
+}
+
+void circuit_evaluate(Circuit c, const Polynomial_t* inputs, uint32_t n_threads, Polynomial_t* outputs) {
+    uint32_t n = c.n_gates;
+    gate_id_t* order = (gate_id_t*) malloc(MAX(n, 1)*sizeof(gate_id_t));
+    if (order == NULL) exit(1);
+    uint32_t n_live = live_gates(c, order);
+    uint32_t* uses = count_uses(c, order, n_live);
+
+    Evaluation e = {0};
+    e.gates = c.gates;
+    e.values = (Polynomial_t*) malloc(MAX(n, 1)*sizeof(Polynomial_t));
+    e.pending = (atomic_uint*) malloc(MAX(n, 1)*sizeof(atomic_uint));
+    e.remaining = (atomic_uint*) malloc(MAX(n, 1)*sizeof(atomic_uint));
+    e.first_reader = (uint32_t*) calloc(n+1, sizeof(uint32_t));
+    e.readers = (gate_id_t*) malloc(2*MAX(n_live, 1)*sizeof(gate_id_t));
+    e.owned = (bool*) calloc(MAX(n, 1), sizeof(bool));
+    e.reusable = (bool*) calloc(MAX(n, 1), sizeof(bool));
+    if (e.values == NULL || e.pending == NULL || e.remaining == NULL || e.first_reader == NULL || e.readers == NULL || e.owned == NULL || e.reusable == NULL) exit(1);
+
+    // Readers of each gate, grouped by gate
+    uint32_t n_operations = 0;
+    for (uint32_t k = 0; k < n_live; k++) {
+        gate_id_t id = order[k];
+        Gate g = c.gates[id];
+        atomic_init(&e.pending[id], 0);
+        atomic_init(&e.remaining[id], uses[id]);
+        if (!is_operation(g)) {
+            // Inputs are borrowed, constants are deleted at the end
+            if (g.type == GATE_INPUT) e.values[id] = (Polynomial_t){inputs[g.a].coefficients, inputs[g.a].degree, 0};
+            else e.values[id] = constant_polynom(g.a);
+            continue;
+        }
+        n_operations++;
+        e.owned[id] = true;
+        e.first_reader[g.a+1]++;
+        e.first_reader[g.b+1]++;
+        if (uses[g.a] == 1 && g.type == GATE_XOR) e.reusable[g.a] = true;
+        if (uses[g.b] == 1 && g.type == GATE_XOR) e.reusable[g.b] = true;
+    }
+    for (uint32_t id = 1; id <= n; id++) e.first_reader[id] += e.first_reader[id-1];
+    for (uint32_t k = 0; k < n_live; k++) {
+        gate_id_t id = order[k];
+        Gate g = c.gates[id];
+        if (!is_operation(g)) continue;
+        if (e.owned[g.a]) atomic_fetch_add(&e.pending[id], 1);
+        if (e.owned[g.b]) atomic_fetch_add(&e.pending[id], 1);
+        // first_reader[g] runs to the end of the readers of g, and is moved back below
+        e.readers[e.first_reader[g.a]++] = id;
+        e.readers[e.first_reader[g.b]++] = id;
+    }
+    for (uint32_t id = n; id > 0; id--) e.first_reader[id] = e.first_reader[id-1];
+    e.first_reader[0] = 0;
+    for (uint32_t id = 0; id < n; id++) {
+        if (!e.owned[id]) e.reusable[id] = false;
+    }
+
+    // Gates read only from inputs and constants start, shared round-robin
+    e.n_threads = MAX(MIN(n_threads, n_operations), 1);
+    e.deques = (GateDeque*) malloc(e.n_threads*sizeof(GateDeque));
+    Worker* workers = (Worker*) malloc(e.n_threads*sizeof(Worker));
+    pthread_t* threads = (pthread_t*) malloc(e.n_threads*sizeof(pthread_t));
+    if (e.deques == NULL || workers == NULL || threads == NULL) exit(1);
+    for (uint32_t t = 0; t < e.n_threads; t++) {
+        pthread_mutex_init(&e.deques[t].lock, NULL);
+        e.deques[t].gates = (gate_id_t*) malloc(MAX(n_operations, 1)*sizeof(gate_id_t));
+        if (e.deques[t].gates == NULL) exit(1);
+        e.deques[t].top = e.deques[t].bottom = 0;
+    }
+    atomic_init(&e.queued, 0);
+    pthread_mutex_init(&e.idle_lock, NULL);
+    pthread_cond_init(&e.idle, NULL);
+    uint32_t next = 0;
+    for (uint32_t k = 0; k < n_live; k++) {
+        gate_id_t id = order[k];
+        if (e.owned[id] && atomic_load(&e.pending[id]) == 0) deque_push(&e, &e.deques[next++ % e.n_threads], id);
+    }
+    atomic_init(&e.left, n_operations);
+
+    for (uint32_t t = 0; t < e.n_threads; t++) {
+        workers[t] = (Worker){&e, t};
+        if (t > 0 && pthread_create(&threads[t], NULL, evaluation_worker, &workers[t]) != 0) exit(1);
+    }
+    evaluation_worker(&workers[0]);
+    for (uint32_t t = 1; t < e.n_threads; t++) pthread_join(threads[t], NULL);
+
+    // A computed output is handed over once, the other ones are copies
+    for (uint32_t o = 0; o < c.n_outputs; o++) {
+        gate_id_t id = c.outputs[o];
+        if (e.owned[id]) {
+            outputs[o] = e.values[id];
+            e.owned[id] = false;
+        } else copy_polynom(e.values[id], &outputs[o]);
+    }
+    for (uint32_t k = 0; k < n_live; k++) {
+        if (c.gates[order[k]].type == GATE_CONSTANT) delete_polynom(e.values[order[k]]);
+    }
+
+    for (uint32_t t = 0; t < e.n_threads; t++) {
+        pthread_mutex_destroy(&e.deques[t].lock);
+        free(e.deques[t].gates);
+    }
+    pthread_cond_destroy(&e.idle);
+    pthread_mutex_destroy(&e.idle_lock);
+    free(threads);
+    free(workers);
+    free(e.deques);
+    free(e.reusable);
+    free(e.owned);
+    free(e.readers);
+    free(e.first_reader);
+    free(e.remaining);
+    free(e.pending);
+    free(e.values);
+    free(uses);
+    free(order);
+}
+
+
+typedef struct {
+    const Gate* gates;
+    const gate_id_t* order;
+    uint32_t n_live;
+    // Position in order of the last reader of each gate, UINT32_MAX for the outputs
+    const uint32_t* last_read;
+    const gate_id_t* output_gates;
+    uint32_t n_outputs;
+    uint32_t n_gates;
+    const Polynomial_t* inputs;
+    Polynomial_t* outputs;
+    uint64_t count;
+    atomic_ullong next_block;
+} BatchEvaluation;
+
+// r[j] = x[j] + y[j] or x[j]*y[j] for the n instances of a block
+// Operands read for the last time are consumed: a XOR accumulates into the larger of them, the others are deleted
+static void gate_batch(GateType type, Polynomial_t* x, Polynomial_t* y, bool last_x, bool last_y, uint64_t n, Polynomial_t* r) {
+    for (uint64_t j = 0; j < n; j++) {
+        Polynomial_t big = x[j], small = y[j];
+        bool last_big = last_x, last_small = last_y;
+        if (small.degree > big.degree) {
+            big = y[j];
+            small = x[j];
+            last_big = last_y;
+            last_small = last_x;
+        }
+        r[j] = (Polynomial_t){0};
+        if (type == GATE_AND) mul_add_into(&r[j], big, small);
+        else {
+            // The larger operand first, so that r is allocated once
+            if (last_big) {
+                r[j] = big;
+                last_big = false;
+            } else if (last_small) {
+                r[j] = small;
+                last_small = false;
+                small = big;
+            } else xor_into(&r[j], big);
+            xor_into(&r[j], small);
+        }
+        if (last_big) delete_polynom(big);
+        if (last_small) delete_polynom(small);
+    }
+}
+
+static void* batch_worker(void* arg) {
+    BatchEvaluation* e = (BatchEvaluation*) arg;
+    // values[g*CIRCUIT_BATCH_BLOCK + j] is gate g of instance j of the block
+    Polynomial_t* values = (Polynomial_t*) malloc(MAX(e->n_gates, 1)*CIRCUIT_BATCH_BLOCK*sizeof(Polynomial_t));
+    bool* handed = (bool*) malloc(MAX(e->n_gates, 1)*sizeof(bool));
+    if (values == NULL || handed == NULL) exit(1);
+    // The constants are borrowed, as the copy-on-write of the accumulate functions never writes to them
+    pol_word_t constant_words[2] = {0, 1};
+
+    for (;;) {
+        uint64_t first = atomic_fetch_add(&e->next_block, 1)*CIRCUIT_BATCH_BLOCK;
+        if (first >= e->count) break;
+        uint64_t n = MIN((uint64_t)CIRCUIT_BATCH_BLOCK, e->count - first);
+
+        for (uint32_t k = 0; k < e->n_live; k++) {
+            gate_id_t id = e->order[k];
+            Gate g = e->gates[id];
+            Polynomial_t* r = values + (uint64_t)id*CIRCUIT_BATCH_BLOCK;
+            if (g.type == GATE_INPUT) {
+                const Polynomial_t* in = e->inputs + g.a*e->count + first;
+                for (uint64_t j = 0; j < n; j++) r[j] = (Polynomial_t){in[j].coefficients, in[j].degree, 0};
+                continue;
+            }
+            if (g.type == GATE_CONSTANT) {
+                for (uint64_t j = 0; j < n; j++) r[j] = (Polynomial_t){&constant_words[g.a], 0, 0};
+                continue;
+            }
+            // Computed operands read for the last time
+            bool last_a = e->last_read[g.a] == k && is_operation(e->gates[g.a]);
+            bool last_b = g.b != g.a && e->last_read[g.b] == k && is_operation(e->gates[g.b]);
+            gate_batch(g.type, values + (uint64_t)g.a*CIRCUIT_BATCH_BLOCK, values + (uint64_t)g.b*CIRCUIT_BATCH_BLOCK, last_a, last_b, n, r);
+        }
+
+        // A computed output is handed over once, the other ones are copies
+        for (uint32_t o = 0; o < e->n_outputs; o++) handed[e->output_gates[o]] = false;
+        for (uint32_t o = 0; o < e->n_outputs; o++) {
+            gate_id_t id = e->output_gates[o];
+            Polynomial_t* r = values + (uint64_t)id*CIRCUIT_BATCH_BLOCK;
+            Polynomial_t* out = e->outputs + o*e->count + first;
+            if (is_operation(e->gates[id]) && !handed[id]) {
+                memcpy(out, r, n*sizeof(Polynomial_t));
+                handed[id] = true;
+            } else {
+                for (uint64_t j = 0; j < n; j++) copy_polynom(r[j], &out[j]);
+            }
+        }
+    }
+
+    free(handed);
+    free(values);
+    return NULL;
+}
+
+static void* batch_thread(void* arg) {
+    batch_worker(arg);
+    pol_pool_trim();
+    return NULL;
+}
+
+void circuit_evaluate_batch(Circuit c, const Polynomial_t* inputs, uint64_t count, uint32_t n_threads, Polynomial_t* outputs) {
+    uint32_t n = c.n_gates;
+    gate_id_t* order = (gate_id_t*) malloc(MAX(n, 1)*sizeof(gate_id_t));
+    if (order == NULL) exit(1);
+    uint32_t n_live = live_gates(c, order);
+    // The gates run in order, so the last reader of a value is known beforehand, and can consume it
+    uint32_t* last_read = (uint32_t*) calloc(MAX(n, 1), sizeof(uint32_t));
+    if (last_read == NULL) exit(1);
+    for (uint32_t k = 0; k < n_live; k++) {
+        Gate g = c.gates[order[k]];
+        if (!is_operation(g)) continue;
+        last_read[g.a] = last_read[g.b] = k;
+    }
+    for (uint32_t o = 0; o < c.n_outputs; o++) last_read[c.outputs[o]] = UINT32_MAX;
+
+    BatchEvaluation e = {c.gates, order, n_live, last_read, c.outputs, c.n_outputs, n, inputs, outputs, count, 0};
+    uint64_t n_blocks = (count + CIRCUIT_BATCH_BLOCK - 1) / CIRCUIT_BATCH_BLOCK;
+    n_threads = (uint32_t) MAX(MIN((uint64_t)n_threads, n_blocks), 1);
+    pthread_t* threads = (pthread_t*) malloc(n_threads*sizeof(pthread_t));
+    if (threads == NULL) exit(1);
+    for (uint32_t t = 1; t < n_threads; t++) {
+        if (pthread_create(&threads[t], NULL, batch_thread, &e) != 0) exit(1);
+    }
+    batch_worker(&e);
+    for (uint32_t t = 1; t < n_threads; t++) pthread_join(threads[t], NULL);
+
+    free(threads);
+    free(last_read);
+    free(order);
+}
+
+
+// Seconds per word product and per XORed word, measured once per process
+static double word_product_seconds;
+static double xor_word_seconds;
+static pthread_once_t rates_once = PTHREAD_ONCE_INIT;
+
+static double seconds_since(struct timespec start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start.tv_sec) + 1e-9*(double)(now.tv_nsec - start.tv_nsec);
+}
+
+// A few milliseconds of products of the kernel size, and of XORs of polynoms that fit in cache
+// The operands are a fixed pattern, so that the random stream of the caller is left alone
+static void measure_rates(void) {
+    const uint64_t n = 16, n_xor = 1024;
+    uint64_t capacity;
+    pol_word_t* words = pol_allocate(4*n + n_xor, &capacity);
+    for (uint64_t i = 0; i < 2*n; i++) words[i] = 0x9E3779B97F4A7C15ULL*(i+1);
+    uint64_t reps = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        for (uint8_t k = 0; k < 64; k++) mul_words(words, n, words + n, n, words + 2*n);
+        reps += 64;
+    } while (seconds_since(start) < 2e-3);
+    word_product_seconds = seconds_since(start) / (double)(reps*mul_words_cost(n, n));
+
+    pol_word_t* xor_words = words + 4*n;
+    for (uint64_t i = 0; i < n_xor; i++) xor_words[i] = 0x9E3779B97F4A7C15ULL*(i+1);
+    Polynomial_t x = {xor_words, n_xor*POL_WORD_BITS - 1, 0};
+    Polynomial_t y = {0};
+    reps = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        for (uint8_t k = 0; k < 64; k++) xor_into(&y, x);
+        reps += 64;
+    } while (seconds_since(start) < 2e-3);
+    xor_word_seconds = seconds_since(start) / (double)(reps*n_xor);
+    delete_polynom(y);
+    pol_release(words, capacity);
+}
+
+void circuit_estimate(Circuit c, const CipherStats* inputs, CipherStats* outputs, CircuitCost* cost) {
+    uint32_t n = c.n_gates;
+    gate_id_t* order = (gate_id_t*) malloc(MAX(n, 1)*sizeof(gate_id_t));
+    CipherStats* stats = (CipherStats*) malloc(MAX(n, 1)*sizeof(CipherStats));
+    uint32_t* last_read = (uint32_t*) calloc(MAX(n, 1), sizeof(uint32_t));
+    if (order == NULL || stats == NULL || last_read == NULL) exit(1);
+    uint32_t n_live = live_gates(c, order);
+    for (uint32_t k = 0; k < n_live; k++) {
+        Gate g = c.gates[order[k]];
+        if (is_operation(g)) last_read[g.a] = last_read[g.b] = k;
+    }
+    for (uint32_t o = 0; o < c.n_outputs; o++) last_read[c.outputs[o]] = UINT32_MAX;
+
+    // The values are counted from their gate to their last reader, in the order of circuit_evaluate_batch
+    CircuitCost total = {0};
+    uint64_t bytes = 0;
+    for (uint32_t k = 0; k < n_live; k++) {
+        gate_id_t id = order[k];
+        Gate g = c.gates[id];
+        if (g.type == GATE_INPUT) {
+            stats[id] = inputs[g.a];
+            continue;
+        }
+        if (g.type == GATE_CONSTANT) {
+            stats[id] = (CipherStats){0, 0, 0};
+            continue;
+        }
+        CipherStats x = stats[g.a], y = stats[g.b];
+        uint64_t nx = POL_WORDS(x.degree + 1), ny = POL_WORDS(y.degree + 1);
+        if (g.type == GATE_AND) {
+            stats[id] = (CipherStats){x.degree + y.degree, x.noise + y.noise, MAX(x.depth, y.depth) + 1};
+            total.and_gates++;
+            total.word_products += mul_words_cost(nx, ny);
+        } else {
+            stats[id] = (CipherStats){MAX(x.degree, y.degree), MAX(x.noise, y.noise), MAX(x.depth, y.depth)};
+            total.xor_gates++;
+            total.xor_words += nx + ny;
+        }
+        bytes += POL_WORDS(stats[id].degree + 1)*sizeof(pol_word_t);
+        total.peak_bytes = MAX(total.peak_bytes, bytes);
+        if (last_read[g.a] == k && is_operation(c.gates[g.a])) bytes -= nx*sizeof(pol_word_t);
+        if (g.b != g.a && last_read[g.b] == k && is_operation(c.gates[g.b])) bytes -= ny*sizeof(pol_word_t);
+    }
+
+    if (outputs != NULL) {
+        for (uint32_t o = 0; o < c.n_outputs; o++) outputs[o] = stats[c.outputs[o]];
+    }
+    if (cost != NULL) {
+        pthread_once(&rates_once, measure_rates);
+        total.seconds = (double)total.word_products*word_product_seconds + (double)total.xor_words*xor_word_seconds;
+        *cost = total;
+    }
+    free(last_read);
+    free(stats);
+    free(order);
+}
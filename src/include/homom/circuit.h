@@ -0,0 +1,269 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "polynom.h"
+
+#define gate_id_t uint32_t
+
+#define CIRCUIT_FALSE 0
+#define CIRCUIT_TRUE 1
+
+// Instances evaluated together by circuit_evaluate_batch, each gate running over all of them in turn
+#define CIRCUIT_BATCH_BLOCK 16
+
+
+/**
+ * @file circuit.h
+ * @brief Circuits of gates on encrypted bits.
+ *
+ * A Circuit is a DAG of XOR and AND gates on encrypted bits, built once and then evaluated as a single parallel job.
+ * Gates are simplified while the circuit is built: constants are folded, and a gate equal to an existing one is not added twice (common subexpression elimination).
+ * circuit_optimize then rebalances the chains of AND gates, so that the products are evaluated as balanced trees.
+ * circuit_evaluate runs the gates on threads started for the evaluation, with work stealing, and reuses the buffer of a value for the XOR that reads it last.
+ * circuit_evaluate_batch runs the same circuit on many independent instances, each gate being applied to a block of instances at once.
+ * circuit_estimate predicts, before any evaluation, the metadata of the outputs and what the evaluation will cost.
+ *
+ * @see Circuit
+*/
+
+
+/**
+ * @brief Metadata of an encrypted bit
+ *
+ * A product adds the degrees and the noises of its factors, and a sum keeps the highest ones.
+ * Decryption is correct as long as the noise stays below the degree of the secret key.
+ *
+ * @param degree Degree of the ciphertext, which drives the cost of the products that read it.
+ * @param noise Bound on the degree of the noise, the remainder of the ciphertext by the secret key.
+ * @param depth Number of products on the longest path from a fresh ciphertext.
+*/
+typedef struct {
+    pol_degree_t degree;
+    pol_degree_t noise;
+    uint32_t depth;
+} CipherStats;
+
+/**
+ * @brief Predicted cost of a circuit
+ *
+ * @param and_gates Number of AND gates evaluated.
+ * @param xor_gates Number of XOR gates evaluated.
+ * @param word_products Carry-less products of 64-bit words done by the AND gates, as estimated by mul_words_cost.
+ * @param xor_words Words read by the XOR gates.
+ * @param peak_bytes Coefficients alive at once when the gates run one after the other, the outputs included.
+ * @param seconds Predicted time on one thread.
+*/
+typedef struct {
+    uint64_t and_gates;
+    uint64_t xor_gates;
+    uint64_t word_products;
+    uint64_t xor_words;
+    uint64_t peak_bytes;
+    double seconds;
+} CircuitCost;
+
+/**
+ * @brief Gate types
+ *
+ * NOT is a XOR with CIRCUIT_TRUE, and OR is a XOR of the operands and of their AND.
+*/
+typedef enum {
+    GATE_CONSTANT,
+    GATE_INPUT,
+    GATE_XOR,
+    GATE_AND
+} GateType;
+
+/**
+ * @brief Gate structure
+ *
+ * @param type Type of the gate.
+ * @param a First operand, or value of a constant, or index of an input.
+ * @param b Second operand.
+ * @param level Number of AND gates on the longest path from the inputs.
+*/
+typedef struct {
+    GateType type;
+    gate_id_t a;
+    gate_id_t b;
+    uint32_t level;
+} Gate;
+
+/**
+ * @brief Circuit structure
+ *
+ * Gates CIRCUIT_FALSE and CIRCUIT_TRUE are the constants, and the operands of a gate always have lower ids than the gate itself, except after circuit_optimize.
+ *
+ * @param gates Array of gates.
+ * @param n_gates Number of gates.
+ * @param capacity Number of gates the array can hold.
+ * @param table Hash table of the XOR and AND gates, holding gate ids plus one.
+ * @param table_size Number of slots of the table, a power of two.
+ * @param outputs Array of output gates.
+ * @param n_outputs Number of outputs.
+ * @param outputs_capacity Number of outputs the array can hold.
+ * @param n_inputs Number of inputs.
+*/
+typedef struct {
+    Gate* gates;
+    uint32_t n_gates;
+    uint32_t capacity;
+    uint32_t* table;
+    uint32_t table_size;
+    gate_id_t* outputs;
+    uint32_t n_outputs;
+    uint32_t outputs_capacity;
+    uint32_t n_inputs;
+} Circuit;
+
+/**
+ * @brief Create an empty circuit
+ *
+ * @param[out] c Pointer to the circuit to initialize.
+*/
+void circuit_init(Circuit* c);
+
+/**
+ * @brief Delete a circuit
+ *
+ * @param[in] c Circuit to delete.
+*/
+void circuit_clear(Circuit c);
+
+/**
+ * @brief Add an input
+ *
+ * Inputs are numbered in the order they are added, which is the order of the ciphertexts given to circuit_evaluate.
+ *
+ * @param[in,out] c Circuit.
+ * @return Gate of the input.
+*/
+gate_id_t circuit_input(Circuit* c);
+
+/**
+ * @brief Add a XOR gate
+ *
+ * @param[in,out] c Circuit.
+ * @param[in] a First operand.
+ * @param[in] b Second operand.
+ * @return Gate of a + b, which may be an existing gate.
+*/
+gate_id_t circuit_xor(Circuit* c, gate_id_t a, gate_id_t b);
+
+/**
+ * @brief Add an AND gate
+ *
+ * @param[in,out] c Circuit.
+ * @param[in] a First operand.
+ * @param[in] b Second operand.
+ * @return Gate of a*b, which may be an existing gate.
+*/
+gate_id_t circuit_and(Circuit* c, gate_id_t a, gate_id_t b);
+
+/**
+ * @brief Add a NOT gate
+ *
+ * @param[in,out] c Circuit.
+ * @param[in] a Operand.
+ * @return Gate of a + 1, which may be an existing gate.
+*/
+gate_id_t circuit_not(Circuit* c, gate_id_t a);
+
+/**
+ * @brief Add an OR gate
+ *
+ * @param[in,out] c Circuit.
+ * @param[in] a First operand.
+ * @param[in] b Second operand.
+ * @return Gate of a + b + a*b, which may be an existing gate.
+*/
+gate_id_t circuit_or(Circuit* c, gate_id_t a, gate_id_t b);
+
+/**
+ * @brief Add an output
+ *
+ * Outputs are numbered in the order they are added, which is the order of the ciphertexts returned by circuit_evaluate.
+ *
+ * @param[in,out] c Circuit.
+ * @param[in] g Gate to output.
+*/
+void circuit_output(Circuit* c, gate_id_t g);
+
+/**
+ * @brief Build an adder
+ *
+ * This function adds the gates of a Brent-Kung adder of two integers of width bits, modulo 2^width.
+ *
+ * @param[in,out] c Circuit.
+ * @param[in] a Gates of the bits of the first integer, the least significant one first.
+ * @param[in] b Gates of the bits of the second integer.
+ * @param[in] width Number of bits.
+ * @param[out] sum Gates of the width bits of the sum.
+*/
+void circuit_add(Circuit* c, const gate_id_t* a, const gate_id_t* b, uint32_t width, gate_id_t* sum);
+
+/**
+ * @brief Optimize a circuit
+ *
+ * Each tree of AND gates whose inner gates are read once is rebuilt as a balanced tree, the operands of lowest level being multiplied first.
+ * The gates that no output depends on are ignored by circuit_evaluate.
+ *
+ * @param[in,out] c Circuit.
+*/
+void circuit_optimize(Circuit* c);
+
+/**
+ * @brief Get the number of AND levels of a circuit
+ *
+ * @param[in] c Circuit.
+ * @return Highest level of the outputs.
+*/
+uint32_t circuit_depth(Circuit c);
+
+/**
+ * @brief Evaluate a circuit
+ *
+ * The gates run on n_threads threads, the calling one included, each taking the gates whose operands are ready and stealing from the others when it has none left.
+ * A thread that finds no gate ready sleeps until one is, and the threads are started and joined by each call.
+ * A value is deleted as soon as its last reader is done, and the last reader of a value read once reuses its buffer if it is a XOR.
+ *
+ * @param[in] c Circuit.
+ * @param[in] inputs The c.n_inputs encrypted bits, which are only read.
+ * @param[in] n_threads Number of threads, 0 meaning 1.
+ * @param[out] outputs The c.n_outputs encrypted bits.
+*/
+void circuit_evaluate(Circuit c, const Polynomial_t* inputs, uint32_t n_threads, Polynomial_t* outputs);
+
+/**
+ * @brief Evaluate a circuit on many instances
+ *
+ * The encrypted bits are laid out by input: bit i of instance k is inputs[i*count + k], and output o of instance k is outputs[o*count + k].
+ * The threads take blocks of CIRCUIT_BATCH_BLOCK instances in turn, and go through the gates once per block, each gate running over the whole block.
+ * The instances are independent, so the threads never wait for each other, whatever the depth of the circuit.
+ *
+ * @param[in] c Circuit.
+ * @param[in] inputs The c.n_inputs*count encrypted bits, which are only read.
+ * @param[in] count Number of instances.
+ * @param[in] n_threads Number of threads, 0 meaning 1.
+ * @param[out] outputs The c.n_outputs*count encrypted bits.
+*/
+void circuit_evaluate_batch(Circuit c, const Polynomial_t* inputs, uint64_t count, uint32_t n_threads, Polynomial_t* outputs);
+
+/**
+ * @brief Predict the outputs and the cost of a circuit
+ *
+ * The metadata of the inputs go through the gates as they would through the ciphertexts, the constants having no noise.
+ * The time is the number of word products and of XORed words, at rates measured on the first call that asks for a cost.
+ * Evaluating on several threads divides the time by up to their number, and keeps up to one more value alive per thread.
+ *
+ * @param[in] c Circuit.
+ * @param[in] inputs Metadata of the c.n_inputs inputs.
+ * @param[out] outputs Metadata of the c.n_outputs outputs, may be NULL.
+ * @param[out] cost Predicted cost, may be NULL.
+ *
+ * @see CipherStats
+ * @see CircuitCost
+*/
+void circuit_estimate(Circuit c, const CipherStats* inputs, CipherStats* outputs, CircuitCost* cost);
@@ -1,46 +1,131 @@
 #include "homomorph.h"
 
+#include <pthread.h>
+#include <string.h>
+
+#include "circuit.h"
+#include "pool.h"
+#include "random.h"
+#include "words.h"
+
 
 static SecKey gen_secret_key(pol_degree_t d) {
     SecKey sk = random_polynom(d);
-    sk.coefficients[d] = true;
+    set_coefficient(&sk, d, true);
     return sk;
 }
 
-static PubKey gen_public_key(SecKey sk, pol_degree_t dp, pol_degree_t delta, uint64_t tau) {
+// S*Q + X*R, with Q of degree dp and R of degree delta
+static void gen_public_key_element(SecKey sk, pol_degree_t dp, pol_degree_t delta, Polynomial_t* element) {
+    Polynomial_t e = {0};
+    Polynomial_t q = random_polynom(dp);
+    mul_add_into(&e, (Polynomial_t)sk, q);
+    delete_polynom(q);
+    Polynomial_t r = random_polynom(delta);
+    shift_xor_into(&e, r, 1);
+    delete_polynom(r);
+    *element = e;
+}
+
+typedef struct {
+    void (*run)(void* arg, uint64_t first, uint64_t last);
+    void* arg;
+    uint64_t first;
+    uint64_t last;
+} ParallelTask;
+
+static void* parallel_thread(void* arg) {
+    ParallelTask* task = (ParallelTask*) arg;
+    task->run(task->arg, task->first, task->last);
+    // The temporaries cached by this thread would be lost when it exits
+    pol_pool_trim();
+    return NULL;
+}
+
+// Runs run on n_threads contiguous shares of [0, n), the calling thread taking the first one
+static void run_parallel(uint64_t n, uint32_t n_threads, void (*run)(void*, uint64_t, uint64_t), void* arg) {
+    if (n == 0) return;
+    if (n_threads > n) n_threads = (uint32_t)n;
+    if (n_threads <= 1) {
+        run(arg, 0, n);
+        return;
+    }
+    ParallelTask* tasks = (ParallelTask*) malloc(n_threads*sizeof(ParallelTask));
+    pthread_t* threads = (pthread_t*) malloc(n_threads*sizeof(pthread_t));
+    if (tasks == NULL || threads == NULL) exit(1);
+    for (uint32_t t = 0; t < n_threads; t++) {
+        tasks[t] = (ParallelTask){run, arg, n*t/n_threads, n*(t+1)/n_threads};
+        if (t > 0 && pthread_create(&threads[t], NULL, parallel_thread, &tasks[t]) != 0) exit(1);
+    }
+    run(arg, tasks[0].first, tasks[0].last);
+    for (uint32_t t = 1; t < n_threads; t++) pthread_join(threads[t], NULL);
+    free(threads);
+    free(tasks);
+}
+
+static uint32_t homomorph_threads = 1;
+
+void set_homomorph_threads(uint32_t n_threads) {
+    homomorph_threads = MAX(n_threads, 1);
+}
+
+
+typedef struct {
+    SecKey sk;
+    pol_degree_t dp;
+    pol_degree_t delta;
+    PubKey pk;
+    const uint8_t* seed;
+} KeyGenTask;
+
+// Element i is drawn from its own stream, keyed by block i of the ChaCha20 stream of the seed
+// The public key is then the same whatever the number of threads
+static void seed_element(const uint8_t* seed, uint64_t i) {
+    const uint8_t nonce[12] = {0};
+    uint8_t key[64];
+    chacha20_block(seed, (uint32_t)i, nonce, key);
+    pol_random_seed(key);
+}
+
+static void gen_public_key_range(void* arg, uint64_t first, uint64_t last) {
+    KeyGenTask* task = (KeyGenTask*) arg;
+    for (uint64_t i = first; i < last; i++) {
+        seed_element(task->seed, i);
+        gen_public_key_element(task->sk, task->dp, task->delta, &(task->pk.elements[i]));
+    }
+}
+
+static PubKey gen_public_key(SecKey sk, pol_degree_t dp, pol_degree_t delta, uint64_t tau, uint32_t n_threads) {
     PubKey pk;
     pk.size = tau;
+    // An element is S*Q + X*R with R of degree delta
+    pk.noise = delta + 1;
+    if (tau > UINT32_MAX) exit(1);
     pk.elements = (Polynomial_t*) malloc(tau*sizeof(Polynomial_t));
     if (pk.elements == NULL) exit(1);
-    Polynomial_t p1, p2;
-    Polynomial_t tmp_pol1, tmp_pol2;
-    for (uint64_t i = 0; i < tau; i++) {
-        // First term
-        tmp_pol1 = random_polynom(dp);
-        multiply_polynoms((Polynomial_t)sk, tmp_pol1, &p1);
-        delete_polynom(tmp_pol1);
-        // Second term
-        tmp_pol1 = monom(1);
-        tmp_pol2 = random_polynom(delta);
-        multiply_polynoms(tmp_pol1, tmp_pol2, &p2);
-        delete_polynom(tmp_pol1);
-        delete_polynom(tmp_pol2);
-        // Add terms
-        add_polynoms(p1, p2, &(pk.elements[i]));
-        delete_polynom(p1);
-        delete_polynom(p2);
-    }
+
+    uint8_t seed[32];
+    pol_random_fill(seed, sizeof(seed));
+    KeyGenTask task = {sk, dp, delta, pk, seed};
+    run_parallel(tau, n_threads, gen_public_key_range, &task);
+
+    // The stream of the calling thread was replaced by the one of an element
+    seed_element(seed, tau);
     return pk;
 }
 
 void homomorph_init(pol_degree_t d, pol_degree_t dp, pol_degree_t delta, uint64_t tau, HomomContext* ctx) {
+    homomorph_init_threads(d, dp, delta, tau, 1, ctx);
+}
+
+void homomorph_init_threads(pol_degree_t d, pol_degree_t dp, pol_degree_t delta, uint64_t tau, uint32_t n_threads, HomomContext* ctx) {
     if (ctx == NULL) return;
     ctx->sk = gen_secret_key(d);
     ctx->d = d;
     ctx->dp = dp;
     ctx->delta = delta;
     ctx->tau = tau;
-    ctx->pk = gen_public_key(ctx->sk, dp, delta, tau);
+    ctx->pk = gen_public_key(ctx->sk, dp, delta, tau, n_threads);
 }
 
 void homomorph_clear(HomomContext ctx) {
@@ -51,71 +136,992 @@ void homomorph_clear(HomomContext ctx) {
     free(ctx.pk.elements);
 }
 
+// Highest degree of the elements of the public key, the one of the ciphertexts it makes
+static pol_degree_t key_degree(PubKey pk) {
+    pol_degree_t max_degree = 0;
+    for (uint64_t i = 0; i < pk.size; i++) max_degree = MAX(max_degree, pk.elements[i].degree);
+    return max_degree;
+}
+
+// A ciphertext starts as its bit, in a buffer large enough for the whole sum
+static Polynomial_t cipher_start(bool bit, pol_degree_t max_degree) {
+    Polynomial_t p = {0};
+    reserve_polynom(&p, max_degree);
+    p.coefficients[0] = bit;
+    return p;
+}
+
 void encrypt_bit(bool bit, PubKey pk, Part part, Polynomial_t* c) {
     if (part.size < pk.size) exit(1);
-    Polynomial_t p = constant_polynom(bit);
+    // The sum is accumulated in a single buffer, and its degree found once at the end
+    Polynomial_t p = cipher_start(bit, key_degree(pk));
     for (uint64_t i = 0; i < pk.size; i++) {
         if (part.elements[i]) {
-            add_polynoms(p, pk.elements[i], &p);
+            lazy_xor_into(&p, pk.elements[i]);
         }
     }
+    normalize_polynom(&p);
+    *c = p;
+}
+
+// Number of entries of the window starting at element first
+static inline uint64_t window_entries(EncryptTable table, uint64_t first) {
+    return (uint64_t)1 << MIN((uint64_t)table.window, table.pk.size - first);
+}
+
+void encrypt_table_init(PubKey pk, uint64_t memory_budget, EncryptTable* table) {
+    if (table == NULL) return;
+    if (memory_budget == 0) memory_budget = ENCRYPT_TABLE_DEFAULT_BUDGET;
+    pol_degree_t max_degree = key_degree(pk);
+    table->pk = pk;
+    table->n_words = POL_WORDS(max_degree + 1);
+
+    // Largest window within the budget, a table of window k costing ceil(tau/k) * 2^k entries
+    table->window = 1;
+    for (uint8_t k = 2; k <= ENCRYPT_TABLE_MAX_WINDOW && k <= pk.size; k++) {
+        uint64_t bytes = ((pk.size + k-1) / k) * ((uint64_t)1 << k) * table->n_words * sizeof(pol_word_t);
+        if (bytes > memory_budget) break;
+        table->window = k;
+    }
+    table->n_windows = (pk.size + table->window-1) / table->window;
+    table->entries = (pol_word_t*) calloc(table->n_windows * ((uint64_t)1 << table->window) * table->n_words, sizeof(pol_word_t));
+    if (table->entries == NULL) exit(1);
+
+    // Entry m is entry m without its lowest bit, plus the element of that bit
+    for (uint64_t w = 0; w < table->n_windows; w++) {
+        uint64_t first = w * table->window;
+        pol_word_t* entries = table->entries + w * ((uint64_t)1 << table->window) * table->n_words;
+        for (uint64_t m = 1; m < window_entries(*table, first); m++) {
+            pol_word_t* entry = entries + m * table->n_words;
+            const pol_word_t* previous = entries + (m & (m-1)) * table->n_words;
+            Polynomial_t element = pk.elements[first + __builtin_ctzll(m)];
+            uint64_t n = POL_WORDS(element.degree + 1);
+            memcpy(entry, previous, table->n_words*sizeof(pol_word_t));
+            xor_words(entry, element.coefficients, n);
+        }
+    }
+}
+
+void encrypt_table_clear(EncryptTable table) {
+    free(table.entries);
+}
+
+void encrypt_bit_table(bool bit, EncryptTable table, Part part, Polynomial_t* c) {
+    if (part.size < table.pk.size) exit(1);
+    Polynomial_t p = cipher_start(bit, table.n_words * POL_WORD_BITS - 1);
+    for (uint64_t w = 0; w < table.n_windows; w++) {
+        uint64_t first = w * table.window;
+        uint64_t m = 0;
+        for (uint64_t i = 0; first + i < table.pk.size && i < table.window; i++) {
+            m |= (uint64_t)part.elements[first + i] << i;
+        }
+        if (m == 0) continue;
+        // The entry is seen as a polynom of the largest possible degree, normalize_polynom finds the real one of the sum
+        Polynomial_t entry = {0};
+        entry.coefficients = table.entries + (w * ((uint64_t)1 << table.window) + m) * table.n_words;
+        entry.degree = table.n_words * POL_WORD_BITS - 1;
+        lazy_xor_into(&p, entry);
+    }
+    normalize_polynom(&p);
     *c = p;
 }
 
 void decrypt_bit(Polynomial_t c, SecKey sk, bool* bit) {
     Polynomial_t p;
-    divide_polynoms(c, (Polynomial_t)sk, &p);
-    *bit = p.coefficients[0];
+    modulo_polynoms(c, (Polynomial_t)sk, &p);
+    *bit = get_coefficient(p, 0);
     delete_polynom(p);
 }
 
-void encrypt(uint64_t n, PubKey pk, CipheredInt* c) {
-    uint32_t num_bits = sizeof(n)*8;
-    Part part;
-    for (uint32_t i = 0; i < num_bits; i++) {
-        part = random_part(pk.size);
-        encrypt_bit((n >> i) & 1, pk, part, &(c->elements[i]));
-        delete_part(part);
+// Ciphertexts of a group stay in cache while the public key goes through it once
+static uint64_t encrypt_group_size(PubKey pk) {
+    pol_degree_t max_degree = key_degree(pk);
+    return MAX(ENCRYPT_BATCH_BYTES / (POL_WORDS(max_degree + 1)*sizeof(pol_word_t)), 1);
+}
+
+// The part of ciphertext j is bits j*part_words*64 to j*part_words*64 + tau-1 of parts
+static void encrypt_group(const bool* bits, uint64_t count, PubKey pk, const pol_word_t* parts, Polynomial_t* c) {
+    uint64_t part_words = POL_WORDS(pk.size);
+    pol_degree_t max_degree = key_degree(pk);
+    for (uint64_t j = 0; j < count; j++) c[j] = cipher_start(bits[j], max_degree);
+    for (uint64_t i = 0; i < pk.size; i++) {
+        for (uint64_t j = 0; j < count; j++) {
+            if ((parts[j*part_words + i/POL_WORD_BITS] >> (i % POL_WORD_BITS)) & 1) lazy_xor_into(&c[j], pk.elements[i]);
+        }
     }
+    for (uint64_t j = 0; j < count; j++) normalize_polynom(&c[j]);
+}
+
+void encrypt_bits(const bool* bits, uint64_t n, PubKey pk, Polynomial_t* c) {
+    uint64_t part_words = POL_WORDS(pk.size);
+    uint64_t group = encrypt_group_size(pk);
+    uint64_t capacity;
+    pol_word_t* parts = pol_allocate(MIN(group, n)*part_words, &capacity);
+    for (uint64_t first = 0; first < n; first += group) {
+        uint64_t count = MIN(group, n - first);
+        pol_random_fill(parts, count*part_words*sizeof(pol_word_t));
+        encrypt_group(bits + first, count, pk, parts, c + first);
+    }
+    pol_release(parts, capacity);
+}
+
+void encrypt_bits_parts(const bool* bits, uint64_t n, PubKey pk, const pol_word_t* parts, Polynomial_t* c) {
+    uint64_t part_words = POL_WORDS(pk.size);
+    uint64_t group = encrypt_group_size(pk);
+    for (uint64_t first = 0; first < n; first += group) {
+        encrypt_group(bits + first, MIN(group, n - first), pk, parts + first*part_words, c + first);
+    }
+}
+
+// Copies n ciphertexts into a single allocation, the elements then their coefficients, and deletes them
+static Polynomial_t* pack_polynoms(Polynomial_t* bits, uint64_t n) {
+    uint64_t n_words = 0;
+    for (uint64_t i = 0; i < n; i++) n_words += POL_WORDS(bits[i].degree + 1);
+
+    Polynomial_t* elements = (Polynomial_t*) malloc(MAX(n*sizeof(Polynomial_t) + n_words*sizeof(pol_word_t), 1));
+    if (elements == NULL) exit(1);
+    pol_word_t* words = (pol_word_t*)(elements + n);
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t w = POL_WORDS(bits[i].degree + 1);
+        memcpy(words, bits[i].coefficients, w*sizeof(pol_word_t));
+        elements[i] = (Polynomial_t){words, bits[i].degree, 0};
+        words += w;
+        delete_polynom(bits[i]);
+    }
+    return elements;
+}
+
+// Highest degree of n ciphertexts, with no noise nor depth
+static CipherStats degree_stats(const Polynomial_t* bits, uint64_t n) {
+    CipherStats stats = {0, 0, 0};
+    for (uint64_t i = 0; i < n; i++) stats.degree = MAX(stats.degree, bits[i].degree);
+    return stats;
+}
+
+CipheredInt ciphered_int(Polynomial_t* bits, uint32_t width) {
+    CipherStats stats = degree_stats(bits, width);
+    return (CipheredInt){pack_polynoms(bits, width), width, stats};
+}
+
+void delete_ciphered_int(CipheredInt c) {
+    free(c.elements);
+}
+
+CipheredBatch ciphered_batch(Polynomial_t* bits, uint32_t width, uint64_t count) {
+    CipherStats stats = degree_stats(bits, (uint64_t)width*count);
+    return (CipheredBatch){pack_polynoms(bits, (uint64_t)width*count), width, count, stats};
+}
+
+void delete_ciphered_batch(CipheredBatch c) {
+    free(c.elements);
+}
+
+typedef struct {
+    const bool* bits;
+    PubKey pk;
+    Polynomial_t* c;
+} EncryptTask;
+
+static void encrypt_range(void* arg, uint64_t first, uint64_t last) {
+    EncryptTask* task = (EncryptTask*) arg;
+    encrypt_bits(task->bits + first, last - first, task->pk, task->c + first);
+}
+
+void encrypt(uint64_t n, uint32_t width, PubKey pk, CipheredInt* c) {
+    encrypt_many(&n, 1, width, pk, c);
+}
+
+void encrypt_many(const uint64_t* n, uint64_t count, uint32_t width, PubKey pk, CipheredInt* c) {
+    encrypt_many_threads(n, count, width, pk, homomorph_threads, c);
+}
+
+void encrypt_many_threads(const uint64_t* n, uint64_t count, uint32_t width, PubKey pk, uint32_t n_threads, CipheredInt* c) {
+    if (width > CIPHERED_INT_MAX_WIDTH) exit(1);
+    if (count == 0) return;
+    bool* bits = (bool*) malloc(MAX(count*width, 1)*sizeof(bool));
+    Polynomial_t* ciphers = (Polynomial_t*) malloc(MAX(count*width, 1)*sizeof(Polynomial_t));
+    if (bits == NULL || ciphers == NULL) exit(1);
+    for (uint64_t k = 0; k < count; k++) {
+        for (uint32_t i = 0; i < width; i++) bits[k*width + i] = (n[k] >> i) & 1;
+    }
+    // Each thread encrypts a batch of bits with its own random stream
+    EncryptTask task = {bits, pk, ciphers};
+    run_parallel(count*width, n_threads, encrypt_range, &task);
+    for (uint64_t k = 0; k < count; k++) {
+        c[k] = ciphered_int(ciphers + k*width, width);
+        c[k].stats.noise = pk.noise;
+    }
+    free(ciphers);
+    free(bits);
+}
+
+typedef struct {
+    const Polynomial_t* c;
+    DecryptContext ctx;
+    bool* bits;
+} DecryptTask;
+
+static void decrypt_range(void* arg, uint64_t first, uint64_t last) {
+    DecryptTask* task = (DecryptTask*) arg;
+    decrypt_bits(task->c + first, last - first, task->ctx, task->bits + first);
 }
 
 void decrypt(CipheredInt* c, SecKey sk, uint64_t* n) {
+    uint32_t num_bits = c->width;
+    if (num_bits > CIPHERED_INT_MAX_WIDTH) exit(1);
+    // A single reciprocal is cheaper than one division per bit
+    pol_degree_t max_degree = sk.degree;
+    for (uint32_t i = 0; i < num_bits; i++) max_degree = MAX(max_degree, c->elements[i].degree);
+    DecryptContext ctx;
+    decrypt_context_init(sk, max_degree, &ctx);
+    bool bits[CIPHERED_INT_MAX_WIDTH];
+    DecryptTask task = {c->elements, ctx, bits};
+    run_parallel(num_bits, homomorph_threads, decrypt_range, &task);
+    decrypt_context_clear(ctx);
+
     *n = 0;
-    bool bit;
-    for (uint32_t i = 0; i < sizeof(uint64_t); i++) {
-        decrypt_bit(c->elements[i], sk, &bit);
-        *n |= (bit << i);
+    for (uint32_t i = 0; i < num_bits; i++) {
+        *n |= ((uint64_t)bits[i] << i);
     }
 }
 
-static void ciphered_or_bit(Polynomial_t a, Polynomial_t b, Polynomial_t* c) {
-    Polynomial_t sum = {0};
-    Polynomial_t prod = {0};
-    add_polynoms(a, b, &sum);
-    multiply_polynoms(a, b, &prod);
-    add_polynoms(sum, prod, c);
-    delete_polynom(sum);
-    delete_polynom(prod);
+void encrypt_batch(const uint64_t* n, uint64_t count, uint32_t width, PubKey pk, CipheredBatch* c) {
+    if (width > CIPHERED_INT_MAX_WIDTH) exit(1);
+    // An empty batch is still a valid one, so the buffers are never empty
+    bool* bits = (bool*) malloc(MAX(count*width, 1)*sizeof(bool));
+    Polynomial_t* ciphers = (Polynomial_t*) malloc(MAX(count*width, 1)*sizeof(Polynomial_t));
+    if (bits == NULL || ciphers == NULL) exit(1);
+    for (uint32_t i = 0; i < width; i++) {
+        for (uint64_t k = 0; k < count; k++) bits[i*count + k] = (n[k] >> i) & 1;
+    }
+    EncryptTask task = {bits, pk, ciphers};
+    run_parallel(count*width, homomorph_threads, encrypt_range, &task);
+    *c = ciphered_batch(ciphers, width, count);
+    c->stats.noise = pk.noise;
+    free(ciphers);
+    free(bits);
 }
 
+void decrypt_batch(CipheredBatch c, SecKey sk, uint64_t* n) {
+    if (c.width > CIPHERED_INT_MAX_WIDTH) exit(1);
+    uint64_t num_bits = c.width*c.count;
+    pol_degree_t max_degree = sk.degree;
+    for (uint64_t i = 0; i < num_bits; i++) max_degree = MAX(max_degree, c.elements[i].degree);
+    DecryptContext ctx;
+    decrypt_context_init(sk, max_degree, &ctx);
+    bool* bits = (bool*) malloc(MAX(num_bits, 1)*sizeof(bool));
+    if (bits == NULL) exit(1);
+    DecryptTask task = {c.elements, ctx, bits};
+    run_parallel(num_bits, homomorph_threads, decrypt_range, &task);
+    decrypt_context_clear(ctx);
+
+    for (uint64_t k = 0; k < c.count; k++) n[k] = 0;
+    for (uint32_t i = 0; i < c.width; i++) {
+        for (uint64_t k = 0; k < c.count; k++) n[k] |= ((uint64_t)bits[i*c.count + k] << i);
+    }
+    free(bits);
+}
+
+void decrypt_context_init(SecKey sk, pol_degree_t max_degree, DecryptContext* ctx) {
+    if (ctx == NULL) return;
+    if (max_degree < sk.degree) max_degree = sk.degree;
+    ctx->sk = sk;
+    ctx->max_degree = max_degree;
+
+    // mu = floor(X^max_degree / sk), of degree m = max_degree - d
+    Polynomial_t x_n = monom(max_degree);
+    Polynomial_t mu;
+    divide_polynoms(x_n, (Polynomial_t)sk, &mu);
+    delete_polynom(x_n);
+
+    pol_degree_t m = max_degree - sk.degree;
+    ctx->reciprocal = monom(m);
+    for (pol_degree_t i = 0; i <= m; i++) {
+        set_coefficient(&ctx->reciprocal, i, get_coefficient(mu, m-i));
+    }
+    delete_polynom(mu);
+}
+
+void decrypt_context_clear(DecryptContext ctx) {
+    delete_polynom(ctx.reciprocal);
+}
+
+// Coefficients start to start+63 of c, zero past its last word
+static inline pol_word_t read_window(Polynomial_t c, uint64_t start) {
+    uint64_t n_words = POL_WORDS(c.degree + 1);
+    uint64_t w = start / POL_WORD_BITS;
+    uint8_t bits = start % POL_WORD_BITS;
+    if (w >= n_words) return 0;
+    if (bits == 0) return c.coefficients[w];
+    pol_word_t high = w+1 < n_words ? c.coefficients[w+1] << (POL_WORD_BITS-bits) : 0;
+    return (c.coefficients[w] >> bits) | high;
+}
+
+static bool decrypt_bit_ctx(Polynomial_t c, DecryptContext ctx) {
+    if (c.degree > ctx.max_degree) {
+        bool bit;
+        decrypt_bit(c, ctx.sk, &bit);
+        return bit;
+    }
+    bool constant = get_coefficient(c, 0);
+    if (c.degree < ctx.sk.degree) return constant;
+
+    // Barrett: q = floor(floor(c/X^d) * mu / X^m), and its constant coefficient is
+    // the sum of c[d+i] * mu[m-i], with reciprocal[i] = mu[m-i]
+    pol_word_t parity = 0;
+    uint64_t n_words = POL_WORDS(c.degree - ctx.sk.degree + 1);
+    for (uint64_t w = 0; w < n_words; w++) {
+        parity ^= read_window(c, ctx.sk.degree + w*POL_WORD_BITS) & ctx.reciprocal.coefficients[w];
+    }
+    bool q0 = __builtin_parityll(parity);
+
+    // r = c - q*sk, so r(0) = c(0) + q(0)*sk(0)
+    return constant ^ (q0 & get_coefficient(ctx.sk, 0));
+}
+
+void decrypt_bits(const Polynomial_t* c, uint64_t n, DecryptContext ctx, bool* bits) {
+    for (uint64_t i = 0; i < n; i++) {
+        bits[i] = decrypt_bit_ctx(c[i], ctx);
+    }
+}
+
+// a OR b = a + b + ab
+void ciphered_or_bit(Polynomial_t a, Polynomial_t b, Polynomial_t* c) {
+    Polynomial_t p = {0};
+    mul_add_into(&p, a, b);
+    xor_into(&p, a);
+    xor_into(&p, b);
+    *c = p;
+}
+
+// c = a + b + cin, and cout = ab + cin(a + b)
+// ab and cin(a + b) are never both true, so their OR is their sum
 static void ciphered_add_bit(Polynomial_t a, Polynomial_t b, Polynomial_t cin, Polynomial_t* c, Polynomial_t* cout) {
     Polynomial_t sum = {0};
-    Polynomial_t prod = {0};
-    Polynomial_t tcin = {0};
-    add_polynoms(a, b, &sum);
-    add_polynoms(sum, cin, c);
-    multiply_polynoms(a, b, &prod);
-    multiply_polynoms(sum, cin, &tcin);
-    ciphered_or_bit(prod, tcin, cout);
+    xor_into(&sum, a);
+    xor_into(&sum, b);
+    Polynomial_t carry = {0};
+    mul_add_into(&carry, a, b);
+    mul_add_into(&carry, sum, cin);
+    xor_into(&sum, cin);
     *c = sum;
+    *cout = carry;
 }
 
-void ciphered_add(CipheredInt a, CipheredInt b, CipheredInt* c) {
+static void ripple_add(CipheredInt a, CipheredInt b, Polynomial_t* sum) {
     Polynomial_t cin = constant_polynom(0);
-    Polynomial_t sum = {0};
-    for (uint32_t i = sizeof(uint64_t)-1; i >= 0; i--) {
-        ciphered_add_bit(a.elements[i], b.elements[i], cin, &(c->elements[i]), &sum);
+    Polynomial_t cout = {0};
+    for (uint32_t i = 0; i < a.width; i++) {
+        ciphered_add_bit(a.elements[i], b.elements[i], cin, &sum[i], &cout);
         delete_polynom(cin);
-        cin = sum;
+        cin = cout;
+    }
+    delete_polynom(cin);
+}
+
+typedef struct {
+    const Polynomial_t* g;
+    const Polynomial_t* p;
+    Polynomial_t* g_next;
+    Polynomial_t* p_next;
+    uint32_t dist;
+} PrefixLevel;
+
+// (G, P) of bits i-2dist+1 to i from the ones of bits i-dist+1 to i and i-2dist+1 to i-dist
+// G = G_high + P_high*G_low, where the two terms are exclusive, and P = P_high*P_low
+static void prefix_level_range(void* arg, uint64_t first, uint64_t last) {
+    PrefixLevel* level = (PrefixLevel*) arg;
+    for (uint64_t i = first + level->dist; i < last + level->dist; i++) {
+        Polynomial_t g = {0};
+        xor_into(&g, level->g[i]);
+        mul_add_into(&g, level->p[i], level->g[i - level->dist]);
+        level->g_next[i] = g;
+        // The next level only reads P at bits 2dist and above
+        level->p_next[i] = (Polynomial_t){0};
+        if (i >= 2*(uint64_t)level->dist) mul_add_into(&level->p_next[i], level->p[i], level->p[i - level->dist]);
+    }
+}
+
+// Kogge-Stone: log2(width) levels, the gates of a level being independent
+static void kogge_stone_add(CipheredInt a, CipheredInt b, Polynomial_t* sum) {
+    uint32_t width = a.width;
+    Polynomial_t* buffer = (Polynomial_t*) malloc(4*MAX(width, 1)*sizeof(Polynomial_t));
+    if (buffer == NULL) exit(1);
+    Polynomial_t* g = buffer;
+    Polynomial_t* p = g + width;
+    Polynomial_t* g_next = p + width;
+    Polynomial_t* p_next = g_next + width;
+
+    // Generate a_i*b_i and propagate a_i + b_i, the latter being kept for the sum
+    for (uint32_t i = 0; i < width; i++) {
+        g[i] = (Polynomial_t){0};
+        mul_add_into(&g[i], a.elements[i], b.elements[i]);
+        sum[i] = (Polynomial_t){0};
+        xor_into(&sum[i], a.elements[i]);
+        xor_into(&sum[i], b.elements[i]);
+        copy_polynom(sum[i], &p[i]);
+    }
+
+    for (uint32_t dist = 1; dist < width; dist *= 2) {
+        PrefixLevel level = {g, p, g_next, p_next, dist};
+        run_parallel(width - dist, homomorph_threads, prefix_level_range, &level);
+        for (uint32_t i = 0; i < width; i++) {
+            if (i < dist) {
+                g_next[i] = g[i];
+                p_next[i] = (Polynomial_t){0};
+            } else delete_polynom(g[i]);
+            delete_polynom(p[i]);
+        }
+        Polynomial_t* tmp = g;
+        g = g_next;
+        g_next = tmp;
+        tmp = p;
+        p = p_next;
+        p_next = tmp;
+    }
+
+    // g[i] is now the carry out of bit i
+    for (uint32_t i = 0; i < width; i++) {
+        if (i > 0) xor_into(&sum[i], g[i-1]);
+        delete_polynom(p[i]);
+    }
+    for (uint32_t i = 0; i < width; i++) delete_polynom(g[i]);
+    free(buffer);
+}
+
+typedef struct {
+    Polynomial_t* g;
+    Polynomial_t* p;
+    uint64_t start;
+    uint64_t stride;
+    uint32_t dist;
+    bool with_p;
+} BrentKungLevel;
+
+// Combines bits start + k*stride with the ones dist below, in place as a level never reads what it writes
+static void brent_kung_level_range(void* arg, uint64_t first, uint64_t last) {
+    BrentKungLevel* level = (BrentKungLevel*) arg;
+    for (uint64_t k = first; k < last; k++) {
+        uint64_t i = level->start + k*level->stride;
+        mul_add_into(&level->g[i], level->p[i], level->g[i - level->dist]);
+        if (level->with_p) {
+            Polynomial_t p = {0};
+            mul_add_into(&p, level->p[i], level->p[i - level->dist]);
+            delete_polynom(level->p[i]);
+            level->p[i] = p;
+        }
     }
-}
\ No newline at end of file
+}
+
+// Brent-Kung: an up-sweep then a down-sweep of log2(width) levels each, with about 2*width gates in all
+static void brent_kung_add(CipheredInt a, CipheredInt b, Polynomial_t* sum) {
+    uint32_t width = a.width;
+    Polynomial_t* g = (Polynomial_t*) malloc(2*MAX(width, 1)*sizeof(Polynomial_t));
+    if (g == NULL) exit(1);
+    Polynomial_t* p = g + width;
+    for (uint32_t i = 0; i < width; i++) {
+        g[i] = (Polynomial_t){0};
+        mul_add_into(&g[i], a.elements[i], b.elements[i]);
+        sum[i] = (Polynomial_t){0};
+        xor_into(&sum[i], a.elements[i]);
+        xor_into(&sum[i], b.elements[i]);
+        copy_polynom(sum[i], &p[i]);
+    }
+
+    // Up-sweep: bit 2dist*k + 2dist-1 gathers the 2dist bits below it
+    uint32_t dist = 1;
+    for (; 2*(uint64_t)dist <= width; dist *= 2) {
+        BrentKungLevel level = {g, p, 2*dist-1, 2*dist, dist, true};
+        run_parallel((width - (2*dist-1) + 2*dist-1) / (2*dist), homomorph_threads, brent_kung_level_range, &level);
+    }
+    // Down-sweep: bit 2dist*k + 3dist-1 gets the prefix of bit 2dist*k + 2dist-1, only G is read anymore
+    for (dist /= 2; dist >= 1; dist /= 2) {
+        if (3*(uint64_t)dist-1 >= width) continue;
+        BrentKungLevel level = {g, p, 3*dist-1, 2*dist, dist, false};
+        run_parallel((width - (3*dist-1) + 2*dist-1) / (2*dist), homomorph_threads, brent_kung_level_range, &level);
+    }
+
+    // g[i] is now the carry out of bit i
+    for (uint32_t i = 0; i < width; i++) {
+        if (i > 0) xor_into(&sum[i], g[i-1]);
+    }
+    for (uint32_t i = 0; i < width; i++) {
+        delete_polynom(g[i]);
+        delete_polynom(p[i]);
+    }
+    free(g);
+}
+
+// The gates of kogge_stone_add, g and p being width gates of scratch space
+static void build_kogge_stone(Circuit* circuit, const gate_id_t* a, const gate_id_t* b, uint32_t width, gate_id_t* g, gate_id_t* p, gate_id_t* sum) {
+    for (uint32_t i = 0; i < width; i++) {
+        g[i] = circuit_and(circuit, a[i], b[i]);
+        p[i] = circuit_xor(circuit, a[i], b[i]);
+        sum[i] = p[i];
+    }
+    // From the highest bit, so that bit i - dist still holds the previous level
+    for (uint32_t dist = 1; dist < width; dist *= 2) {
+        for (uint32_t i = width; i-- > dist;) {
+            g[i] = circuit_xor(circuit, g[i], circuit_and(circuit, p[i], g[i - dist]));
+            if (i >= 2*(uint64_t)dist) p[i] = circuit_and(circuit, p[i], p[i - dist]);
+        }
+    }
+    for (uint32_t i = 1; i < width; i++) sum[i] = circuit_xor(circuit, sum[i], g[i-1]);
+}
+
+// The gates of an adder as a circuit, whose inputs are the bits of a then the ones of b and whose outputs are the bits of the sum
+// The ripple and Kogge-Stone gates are the ones of ripple_add and kogge_stone_add, and circuit_add builds the Brent-Kung ones
+static void build_adder(Circuit* circuit, CipheredAdder adder, uint32_t width) {
+    gate_id_t* a = (gate_id_t*) malloc(5*MAX(width, 1)*sizeof(gate_id_t));
+    if (a == NULL) exit(1);
+    gate_id_t* b = a + width;
+    gate_id_t* sum = b + width;
+    gate_id_t* g = sum + width;
+    gate_id_t* p = g + width;
+    for (uint32_t i = 0; i < 2*width; i++) a[i] = circuit_input(circuit);
+
+    if (adder == CIPHERED_ADDER_RIPPLE) {
+        gate_id_t carry = CIRCUIT_FALSE;
+        for (uint32_t i = 0; i < width; i++) {
+            gate_id_t half = circuit_xor(circuit, a[i], b[i]);
+            sum[i] = circuit_xor(circuit, half, carry);
+            carry = circuit_xor(circuit, circuit_and(circuit, a[i], b[i]), circuit_and(circuit, half, carry));
+        }
+    } else if (adder == CIPHERED_ADDER_KOGGE_STONE) build_kogge_stone(circuit, a, b, width, g, p, sum);
+    else circuit_add(circuit, a, b, width, sum);
+
+    for (uint32_t i = 0; i < width; i++) circuit_output(circuit, sum[i]);
+    free(a);
+}
+
+// Highest stats of the outputs of a circuit of two integers of width bits, such as an adder, for inputs of the stats of a and b
+static void operation_stats(Circuit circuit, CipherStats a, CipherStats b, uint32_t width, CipherStats* stats, CircuitCost* cost) {
+    CipherStats* io = (CipherStats*) malloc(3*MAX(width, 1)*sizeof(CipherStats));
+    if (io == NULL) exit(1);
+    for (uint32_t i = 0; i < width; i++) {
+        io[i] = a;
+        io[width + i] = b;
+    }
+    circuit_estimate(circuit, io, io + 2*width, cost);
+    if (stats != NULL) {
+        *stats = (CipherStats){0, 0, 0};
+        for (uint32_t i = 2*width; i < 3*width; i++) {
+            stats->degree = MAX(stats->degree, io[i].degree);
+            stats->noise = MAX(stats->noise, io[i].noise);
+            stats->depth = MAX(stats->depth, io[i].depth);
+        }
+    }
+    free(io);
+}
+
+// The Brent-Kung gates, scheduled by the circuit instead of level by level, and the stats of the sum read from the same circuit
+static void circuit_adder(CipheredInt a, CipheredInt b, Polynomial_t* sum, CipherStats* stats) {
+    uint32_t width = a.width;
+    Polynomial_t* inputs = (Polynomial_t*) malloc(2*MAX(width, 1)*sizeof(Polynomial_t));
+    if (inputs == NULL) exit(1);
+    Circuit circuit;
+    circuit_init(&circuit);
+    build_adder(&circuit, CIPHERED_ADDER_CIRCUIT, width);
+    circuit_optimize(&circuit);
+
+    memcpy(inputs, a.elements, width*sizeof(Polynomial_t));
+    memcpy(inputs + width, b.elements, width*sizeof(Polynomial_t));
+    circuit_evaluate(circuit, inputs, homomorph_threads, sum);
+    operation_stats(circuit, a.stats, b.stats, width, stats, NULL);
+    circuit_clear(circuit);
+    free(inputs);
+}
+
+// The stats circuit_estimate gives to the gates, without building them
+static inline CipherStats and_stats(CipherStats x, CipherStats y) {
+    return (CipherStats){x.degree + y.degree, x.noise + y.noise, MAX(x.depth, y.depth) + 1};
+}
+
+static inline CipherStats xor_stats(CipherStats x, CipherStats y) {
+    return (CipherStats){MAX(x.degree, y.degree), MAX(x.noise, y.noise), MAX(x.depth, y.depth)};
+}
+
+// Highest stats of the sum of the ripple, Kogge-Stone and Brent-Kung adders, gate by gate as build_adder lays them out
+static CipherStats level_adder_stats(CipheredAdder adder, CipherStats a, CipherStats b, uint32_t width) {
+    CipherStats half = xor_stats(a, b);
+    CipherStats sum = half;
+    if (adder == CIPHERED_ADDER_RIPPLE) {
+        // The first carry is a*b, the AND with the constant carry in being folded
+        CipherStats carry = and_stats(a, b);
+        for (uint32_t i = 1; i < width; i++) {
+            sum = xor_stats(sum, xor_stats(half, carry));
+            carry = xor_stats(and_stats(a, b), and_stats(half, carry));
+        }
+        return sum;
+    }
+
+    CipherStats g[CIPHERED_INT_MAX_WIDTH], p[CIPHERED_INT_MAX_WIDTH];
+    for (uint32_t i = 0; i < width; i++) {
+        g[i] = and_stats(a, b);
+        p[i] = half;
+    }
+    uint32_t dist = 1;
+    if (adder == CIPHERED_ADDER_KOGGE_STONE) {
+        for (; dist < width; dist *= 2) {
+            for (uint32_t i = width; i-- > dist;) {
+                g[i] = xor_stats(g[i], and_stats(p[i], g[i - dist]));
+                if (i >= 2*(uint64_t)dist) p[i] = and_stats(p[i], p[i - dist]);
+            }
+        }
+    } else {
+        for (; 2*(uint64_t)dist <= width; dist *= 2) {
+            for (uint64_t i = 2*dist-1; i < width; i += 2*dist) {
+                g[i] = xor_stats(g[i], and_stats(p[i], g[i - dist]));
+                p[i] = and_stats(p[i], p[i - dist]);
+            }
+        }
+        for (dist /= 2; dist >= 1; dist /= 2) {
+            for (uint64_t i = 3*(uint64_t)dist-1; i < width; i += 2*dist) g[i] = xor_stats(g[i], and_stats(p[i], g[i - dist]));
+        }
+    }
+    for (uint32_t i = 1; i < width; i++) sum = xor_stats(sum, xor_stats(half, g[i-1]));
+    return sum;
+}
+
+void ciphered_add(CipheredInt a, CipheredInt b, CipheredInt* c) {
+    // The prefix adders do more products, which only pays off when their gates are shared between threads
+    ciphered_add_with(a, b, homomorph_threads > 1 ? CIPHERED_ADDER_CIRCUIT : CIPHERED_ADDER_RIPPLE, c);
+}
+
+void ciphered_add_with(CipheredInt a, CipheredInt b, CipheredAdder adder, CipheredInt* c) {
+    if (a.width != b.width) exit(1);
+    if (a.width > CIPHERED_INT_MAX_WIDTH) exit(1);
+    Polynomial_t* sum = (Polynomial_t*) malloc(MAX(a.width, 1)*sizeof(Polynomial_t));
+    if (sum == NULL) exit(1);
+    // The degree of the bits is known, the stats only tell the noise and the depth
+    CipherStats stats = {0, 0, 0};
+    if (adder == CIPHERED_ADDER_CIRCUIT) circuit_adder(a, b, sum, &stats);
+    else {
+        if (adder == CIPHERED_ADDER_RIPPLE) ripple_add(a, b, sum);
+        else if (adder == CIPHERED_ADDER_KOGGE_STONE) kogge_stone_add(a, b, sum);
+        else brent_kung_add(a, b, sum);
+        if (a.width > 0) stats = level_adder_stats(adder, a.stats, b.stats, a.width);
+    }
+    *c = ciphered_int(sum, a.width);
+    c->stats.noise = stats.noise;
+    c->stats.depth = stats.depth;
+    free(sum);
+}
+
+void estimate_add(CipheredInt a, CipheredInt b, CipheredAdder adder, CipherStats* stats, CircuitCost* cost) {
+    if (a.width != b.width) exit(1);
+    Circuit circuit;
+    circuit_init(&circuit);
+    build_adder(&circuit, adder, a.width);
+    if (adder == CIPHERED_ADDER_CIRCUIT) circuit_optimize(&circuit);
+    operation_stats(circuit, a.stats, b.stats, a.width, stats, cost);
+    circuit_clear(circuit);
+}
+
+pol_degree_t noise_budget(CipherStats stats, SecKey sk) {
+    return stats.noise < sk.degree ? sk.degree - stats.noise : 0;
+}
+
+
+void ciphered_add_batch(CipheredBatch a, CipheredBatch b, CipheredBatch* c) {
+    if (a.width != b.width || a.count != b.count) exit(1);
+    uint32_t width = a.width;
+    uint64_t n = (uint64_t)width*a.count;
+
+    Circuit circuit;
+    circuit_init(&circuit);
+    build_adder(&circuit, CIPHERED_ADDER_RIPPLE, width);
+
+    // The inputs of the circuit are a then b, which is the layout of the two batches one after the other
+    Polynomial_t* inputs = (Polynomial_t*) malloc(MAX(2*n, 1)*sizeof(Polynomial_t));
+    Polynomial_t* sum = (Polynomial_t*) malloc(MAX(n, 1)*sizeof(Polynomial_t));
+    if (inputs == NULL || sum == NULL) exit(1);
+    memcpy(inputs, a.elements, n*sizeof(Polynomial_t));
+    memcpy(inputs + n, b.elements, n*sizeof(Polynomial_t));
+    circuit_evaluate_batch(circuit, inputs, a.count, homomorph_threads, sum);
+    CipherStats stats;
+    operation_stats(circuit, a.stats, b.stats, width, &stats, NULL);
+    *c = ciphered_batch(sum, width, a.count);
+    c->stats.noise = stats.noise;
+    c->stats.depth = stats.depth;
+
+    circuit_clear(circuit);
+    free(sum);
+    free(inputs);
+}
+
+// c += 1
+static void not_into(Polynomial_t* c) {
+    pol_word_t word = 1;
+    Polynomial_t one = {&word, 0, 0};
+    xor_into(c, one);
+}
+
+// Orders the bits of a column by their number of products, the shallowest first
+static void sort_by_level(const Circuit* circuit, gate_id_t* bits, uint32_t n) {
+    for (uint32_t i = 1; i < n; i++) {
+        gate_id_t g = bits[i];
+        uint32_t j = i;
+        for (; j > 0 && circuit->gates[bits[j-1]].level > circuit->gates[g].level; j--) bits[j] = bits[j-1];
+        bits[j] = g;
+    }
+}
+
+// Wallace tree: each layer reduces all the columns at once, every three bits of a column becoming their sum in the column and their carry in the next one
+// The heights shrink by a third per layer and a layer adds one product to the carries, so the depth is logarithmic in the width
+// The two rows left are added by the Kogge-Stone gates
+static void build_multiplier(Circuit* circuit, uint32_t width) {
+    // A column never holds more than 2*width bits: its third, two bits left over and the carries of the third of the previous one
+    uint64_t stride = 2*(uint64_t)MAX(width, 1);
+    gate_id_t* a = (gate_id_t*) malloc(5*MAX(width, 1)*sizeof(gate_id_t));
+    gate_id_t* buffer = (gate_id_t*) malloc(2*MAX(width, 1)*stride*sizeof(gate_id_t));
+    uint32_t* heights = (uint32_t*) malloc(2*MAX(width, 1)*sizeof(uint32_t));
+    if (a == NULL || buffer == NULL || heights == NULL) exit(1);
+    gate_id_t* b = a + width;
+    gate_id_t* g = b + width;
+    gate_id_t* p = g + width;
+    gate_id_t* sum = p + width;
+    gate_id_t* columns = buffer;
+    gate_id_t* next = buffer + width*stride;
+    uint32_t* height = heights;
+    uint32_t* next_height = heights + width;
+    for (uint32_t i = 0; i < 2*width; i++) a[i] = circuit_input(circuit);
+
+    // Column k holds the partial products a_(k-i)*b_i
+    for (uint32_t k = 0; k < width; k++) {
+        height[k] = k+1;
+        for (uint32_t i = 0; i <= k; i++) columns[k*stride + i] = circuit_and(circuit, a[k-i], b[i]);
+    }
+
+    for (;;) {
+        uint32_t max_height = 0;
+        for (uint32_t k = 0; k < width; k++) max_height = MAX(max_height, height[k]);
+        if (max_height <= 2) break;
+        memset(next_height, 0, width*sizeof(uint32_t));
+        for (uint32_t k = 0; k < width; k++) {
+            gate_id_t* column = columns + k*stride;
+            sort_by_level(circuit, column, height[k]);
+            uint32_t i = 0;
+            // Full adder: s = x + y + z and c = xy + z(x + y), whose two terms are exclusive
+            for (; i+3 <= height[k]; i += 3) {
+                gate_id_t x = column[i], y = column[i+1], z = column[i+2];
+                gate_id_t t = circuit_xor(circuit, x, y);
+                next[k*stride + next_height[k]++] = circuit_xor(circuit, t, z);
+                if (k+1 < width) {
+                    gate_id_t c = circuit_xor(circuit, circuit_and(circuit, x, y), circuit_and(circuit, z, t));
+                    next[(k+1)*stride + next_height[k+1]++] = c;
+                }
+            }
+            // Half adder on two bits left: s = x + y and c = xy, otherwise a column of 2 bits would get back to 3 with the carry from below
+            if (i+2 == height[k]) {
+                gate_id_t x = column[i], y = column[i+1];
+                next[k*stride + next_height[k]++] = circuit_xor(circuit, x, y);
+                if (k+1 < width) next[(k+1)*stride + next_height[k+1]++] = circuit_and(circuit, x, y);
+                i += 2;
+            }
+            for (; i < height[k]; i++) next[k*stride + next_height[k]++] = column[i];
+        }
+        gate_id_t* tmp = columns;
+        columns = next;
+        next = tmp;
+        uint32_t* tmp_height = height;
+        height = next_height;
+        next_height = tmp_height;
+    }
+
+    // The two rows replace the inputs, missing bits being 0
+    for (uint32_t k = 0; k < width; k++) {
+        a[k] = height[k] > 0 ? columns[k*stride] : CIRCUIT_FALSE;
+        b[k] = height[k] > 1 ? columns[k*stride + 1] : CIRCUIT_FALSE;
+    }
+    build_kogge_stone(circuit, a, b, width, g, p, sum);
+    for (uint32_t k = 0; k < width; k++) circuit_output(circuit, sum[k]);
+
+    free(heights);
+    free(buffer);
+    free(a);
+}
+
+void ciphered_mul(CipheredInt a, CipheredInt b, CipheredInt* c) {
+    if (a.width != b.width) exit(1);
+    uint32_t width = a.width;
+    Polynomial_t* inputs = (Polynomial_t*) malloc(2*MAX(width, 1)*sizeof(Polynomial_t));
+    Polynomial_t* product = (Polynomial_t*) malloc(MAX(width, 1)*sizeof(Polynomial_t));
+    if (inputs == NULL || product == NULL) exit(1);
+    Circuit circuit;
+    circuit_init(&circuit);
+    build_multiplier(&circuit, width);
+    circuit_optimize(&circuit);
+
+    memcpy(inputs, a.elements, width*sizeof(Polynomial_t));
+    memcpy(inputs + width, b.elements, width*sizeof(Polynomial_t));
+    circuit_evaluate(circuit, inputs, homomorph_threads, product);
+    CipherStats stats;
+    operation_stats(circuit, a.stats, b.stats, width, &stats, NULL);
+    *c = ciphered_int(product, width);
+    c->stats.noise = stats.noise;
+    c->stats.depth = stats.depth;
+
+    circuit_clear(circuit);
+    free(product);
+    free(inputs);
+}
+
+typedef struct {
+    Polynomial_t* lt;
+    Polynomial_t* eq;
+    Polynomial_t* lt_next;
+    Polynomial_t* eq_next;
+    uint64_t n;
+} CompareLevel;
+
+// Bits 2k+1 (high) and 2k (low): lt = lt_high + eq_high*lt_low, whose two terms are exclusive, and eq = eq_high*eq_low
+static void compare_level_range(void* arg, uint64_t first, uint64_t last) {
+    CompareLevel* level = (CompareLevel*) arg;
+    for (uint64_t k = first; k < last; k++) {
+        if (2*k+1 == level->n) {
+            if (level->lt != NULL) level->lt_next[k] = level->lt[2*k];
+            level->eq_next[k] = level->eq[2*k];
+            continue;
+        }
+        if (level->lt != NULL) {
+            Polynomial_t lt = {0};
+            xor_into(&lt, level->lt[2*k+1]);
+            mul_add_into(&lt, level->eq[2*k+1], level->lt[2*k]);
+            level->lt_next[k] = lt;
+            delete_polynom(level->lt[2*k]);
+            delete_polynom(level->lt[2*k+1]);
+        }
+        Polynomial_t eq = {0};
+        // The top level of less-than does not need eq
+        if (level->lt == NULL || level->n > 2) mul_add_into(&eq, level->eq[2*k+1], level->eq[2*k]);
+        level->eq_next[k] = eq;
+        delete_polynom(level->eq[2*k]);
+        delete_polynom(level->eq[2*k+1]);
+    }
+}
+
+// Reduces the pairs (lt_i, eq_i) of the bits to the ones of the whole integers, lt being NULL for equality only
+static void compare_tree(Polynomial_t* lt, Polynomial_t* eq, uint64_t n, Polynomial_t* lt_out, Polynomial_t* eq_out) {
+    Polynomial_t* lt_buffer = (Polynomial_t*) malloc(MAX(n, 1)*sizeof(Polynomial_t));
+    Polynomial_t* eq_buffer = (Polynomial_t*) malloc(MAX(n, 1)*sizeof(Polynomial_t));
+    if (lt_buffer == NULL || eq_buffer == NULL) exit(1);
+    Polynomial_t* lt_next = lt_buffer;
+    Polynomial_t* eq_next = eq_buffer;
+    for (; n > 1; n = (n+1)/2) {
+        CompareLevel level = {lt, eq, lt != NULL ? lt_next : NULL, eq_next, n};
+        run_parallel((n+1)/2, homomorph_threads, compare_level_range, &level);
+        Polynomial_t* tmp = lt;
+        if (lt != NULL) {
+            lt = lt_next;
+            lt_next = tmp;
+        }
+        tmp = eq;
+        eq = eq_next;
+        eq_next = tmp;
+    }
+    if (lt_out != NULL) *lt_out = lt[0];
+    if (eq_out != NULL) *eq_out = eq[0];
+    else delete_polynom(eq[0]);
+    free(lt_buffer);
+    free(eq_buffer);
+}
+
+// Number of levels of compare_tree for n bits
+static uint32_t compare_levels(uint32_t n) {
+    uint32_t levels = 0;
+    for (; n > 1; n = (n+1)/2) levels++;
+    return levels;
+}
+
+// The comparison bit as an integer of width 1
+static CipheredInt comparison_int(Polynomial_t bit, pol_degree_t noise, uint32_t depth) {
+    CipheredInt c = ciphered_int(&bit, 1);
+    c.stats.noise = noise;
+    c.stats.depth = depth;
+    return c;
+}
+
+void ciphered_equal(CipheredInt a, CipheredInt b, CipheredInt* c) {
+    if (a.width != b.width) exit(1);
+    if (a.width == 0) {
+        *c = comparison_int(constant_polynom(true), 0, 0);
+        return;
+    }
+    Polynomial_t* eq = (Polynomial_t*) malloc(a.width*sizeof(Polynomial_t));
+    if (eq == NULL) exit(1);
+    // eq_i = 1 + a_i + b_i
+    for (uint32_t i = 0; i < a.width; i++) {
+        eq[i] = (Polynomial_t){0};
+        xor_into(&eq[i], a.elements[i]);
+        xor_into(&eq[i], b.elements[i]);
+        not_into(&eq[i]);
+    }
+    Polynomial_t bit = {0};
+    compare_tree(NULL, eq, a.width, NULL, &bit);
+    free(eq);
+    // The product of the width bits eq_i
+    pol_degree_t noise = MAX(a.stats.noise, b.stats.noise);
+    *c = comparison_int(bit, a.width*noise, MAX(a.stats.depth, b.stats.depth) + compare_levels(a.width));
+}
+
+void ciphered_less_than(CipheredInt a, CipheredInt b, CipheredInt* c) {
+    if (a.width != b.width) exit(1);
+    if (a.width == 0) {
+        *c = comparison_int(constant_polynom(false), 0, 0);
+        return;
+    }
+    Polynomial_t* lt = (Polynomial_t*) malloc(2*a.width*sizeof(Polynomial_t));
+    if (lt == NULL) exit(1);
+    Polynomial_t* eq = lt + a.width;
+    // lt_i = (1 + a_i)b_i = b_i + a_i*b_i and eq_i = 1 + a_i + b_i
+    for (uint32_t i = 0; i < a.width; i++) {
+        lt[i] = (Polynomial_t){0};
+        mul_add_into(&lt[i], a.elements[i], b.elements[i]);
+        xor_into(&lt[i], b.elements[i]);
+        eq[i] = (Polynomial_t){0};
+        xor_into(&eq[i], a.elements[i]);
+        xor_into(&eq[i], b.elements[i]);
+        not_into(&eq[i]);
+    }
+    Polynomial_t bit = {0};
+    compare_tree(lt, eq, a.width, &bit, NULL);
+    free(lt);
+    // The heaviest term is lt_0 times the eq_i of the bits above it, one more level deep than eq
+    pol_degree_t noise = MAX(a.stats.noise, b.stats.noise);
+    *c = comparison_int(bit, (a.width+1)*noise, MAX(a.stats.depth, b.stats.depth) + 1 + compare_levels(a.width));
+}
+
+typedef struct {
+    Polynomial_t s;
+    CipheredInt a;
+    CipheredInt b;
+    Polynomial_t* c;
+} Select;
+
+// c_i = b_i + s(a_i + b_i)
+static void select_range(void* arg, uint64_t first, uint64_t last) {
+    Select* select = (Select*) arg;
+    for (uint64_t i = first; i < last; i++) {
+        Polynomial_t d = {0};
+        xor_into(&d, select->a.elements[i]);
+        xor_into(&d, select->b.elements[i]);
+        Polynomial_t c = {0};
+        mul_add_into(&c, select->s, d);
+        xor_into(&c, select->b.elements[i]);
+        delete_polynom(d);
+        select->c[i] = c;
+    }
+}
+
+void ciphered_select(CipheredInt s, CipheredInt a, CipheredInt b, CipheredInt* c) {
+    if (a.width != b.width || s.width != 1) exit(1);
+    Polynomial_t* bits = (Polynomial_t*) malloc(MAX(a.width, 1)*sizeof(Polynomial_t));
+    if (bits == NULL) exit(1);
+    Select select = {s.elements[0], a, b, bits};
+    run_parallel(a.width, homomorph_threads, select_range, &select);
+    *c = ciphered_int(bits, a.width);
+    c->stats.noise = s.stats.noise + MAX(a.stats.noise, b.stats.noise);
+    c->stats.depth = MAX(s.stats.depth, MAX(a.stats.depth, b.stats.depth)) + 1;
+    free(bits);
+}
@@ -1,10 +1,19 @@
 #pragma once
 
+#include "circuit.h"
 #include "polynom.h"
 
+/**
+ * @brief Public key
+ * 
+ * @param elements The size encryptions of 0
+ * @param size The number of elements
+ * @param noise The noise degree bound of the ciphertexts encrypted with the key, delta+1 for the keys of homomorph_init
+*/
 typedef struct {
     Polynomial_t* elements;
     uint64_t size;
+    pol_degree_t noise;
 } PubKey;
 
 typedef Polynomial_t SecKey;
@@ -18,10 +27,92 @@ typedef struct {
     uint64_t tau;
 } HomomContext;
 
+/**
+ * @brief Encrypted integer
+ * 
+ * elements holds the width encrypted bits, the least significant one first.
+ * The elements and all their coefficients live in a single allocation, so they borrow their arrays and are read-only.
+ * The integers read from a file have their own elements, whose coefficients stay in the mapped file.
+ * stats holds the highest degree, noise and depth of the bits, which every operation updates from the ones of its operands.
+ * 
+ * @see ciphered_int
+ * @see noise_budget
+ * @see delete_ciphered_int
+*/
 typedef struct {
-    Polynomial_t elements[sizeof(uint64_t)];
+    Polynomial_t* elements;
+    uint32_t width;
+    CipherStats stats;
 } CipheredInt;
 
+#define CIPHERED_INT_MAX_WIDTH 64
+
+/**
+ * @brief Batch of encrypted integers
+ * 
+ * The count integers have the same width, and their bits are stored by position: bit i of integer k is elements[i*count + k].
+ * The bits of a position are contiguous, so a gate applied to all the integers streams through memory, and circuit_evaluate_batch can read them as they are.
+ * As with CipheredInt, everything lives in a single allocation, the elements are read-only, and stats covers all the bits.
+ * 
+ * @see ciphered_batch
+ * @see delete_ciphered_batch
+*/
+typedef struct {
+    Polynomial_t* elements;
+    uint32_t width;
+    uint64_t count;
+    CipherStats stats;
+} CipheredBatch;
+
+/**
+ * @brief Adder circuits
+ * 
+ * CIPHERED_ADDER_RIPPLE passes the carry from bit to bit, so its multiplicative depth is the width.
+ * CIPHERED_ADDER_KOGGE_STONE computes all the carries with a parallel prefix of log2(width) levels, the gates of a level being evaluated concurrently.
+ * CIPHERED_ADDER_BRENT_KUNG is a parallel prefix of 2*log2(width) levels with fewer gates, about 2*width instead of width*log2(width).
+ * CIPHERED_ADDER_CIRCUIT builds the Brent-Kung adder as a Circuit and evaluates it as one job, a gate starting as soon as its operands are ready instead of waiting for its level.
+ * Products add the degrees of their factors, so the carries have about the same degree with any adder: the prefix adders trade more products for levels that can run in parallel.
+*/
+typedef enum {
+    CIPHERED_ADDER_RIPPLE,
+    CIPHERED_ADDER_KOGGE_STONE,
+    CIPHERED_ADDER_BRENT_KUNG,
+    CIPHERED_ADDER_CIRCUIT
+} CipheredAdder;
+
+/**
+ * @brief Precomputed secret key data for fast decryption
+ * 
+ * reciprocal holds the coefficients of floor(X^max_degree / sk) in reverse order.
+ * For a ciphertext of degree at most max_degree, the constant coefficient of the quotient by sk
+ * is the parity of the coefficients of c/X^d masked by reciprocal (Barrett reduction), so decryption takes a single pass over c.
+*/
+typedef struct {
+    SecKey sk;
+    Polynomial_t reciprocal;
+    pol_degree_t max_degree;
+} DecryptContext;
+
+/**
+ * @brief Precomputed public key sums for fast encryption
+ * 
+ * The public key is split in windows of window elements, and entries holds the 2^window sums of the subsets of each window.
+ * Entry m of window w is the sum of the elements w*window + i for the bits i of m, stored on n_words words.
+ * An encryption then takes one addition per window instead of one per element of the part.
+*/
+typedef struct {
+    PubKey pk;
+    uint8_t window;
+    uint64_t n_windows;
+    uint64_t n_words;
+    pol_word_t* entries;
+} EncryptTable;
+
+#define ENCRYPT_TABLE_DEFAULT_BUDGET ((uint64_t)64 << 20)
+#define ENCRYPT_TABLE_MAX_WINDOW 16
+
+#define ENCRYPT_BATCH_BYTES ((uint64_t)256 << 10)
+
 /**
  * @brief Generates a public and a secret key for the homomorphic encryption scheme
  * 
@@ -33,6 +124,24 @@ typedef struct {
 */
 void homomorph_init(pol_degree_t d, pol_degree_t dp, pol_degree_t delta, uint64_t tau, HomomContext* ctx);
 
+/**
+ * @brief Generates the keys on several threads
+ * 
+ * The tau elements of the public key are shared between n_threads threads, the calling one included.
+ * Each element is drawn from its own ChaCha20 stream, derived from the stream of the calling thread,
+ * so seeding the calling thread with pol_random_seed gives the same keys whatever the number of threads.
+ * 
+ * @param[in] d The degree of the secret key
+ * @param[in] dp The degree of the random element
+ * @param[in] delta The degree of the random element
+ * @param[in] tau The size of the public key
+ * @param[in] n_threads The number of threads, 0 and 1 both meaning the calling thread only
+ * @param[out] ctx Pointer to the context to store the public and secret keys
+ * 
+ * @see pol_random_seed
+*/
+void homomorph_init_threads(pol_degree_t d, pol_degree_t dp, pol_degree_t delta, uint64_t tau, uint32_t n_threads, HomomContext* ctx);
+
 /**
  * @brief Deletes the context
  * 
@@ -52,23 +161,177 @@ void homomorph_clear(HomomContext ctx);
 */
 void encrypt_bit(bool bit, PubKey pk, Part part, Polynomial_t* c);
 
+/**
+ * @brief Precomputes the encryption of many bits under the same public key
+ * 
+ * The window is the largest one, up to ENCRYPT_TABLE_MAX_WINDOW, whose table fits in memory_budget bytes.
+ * A window of 1 is used if even that one does not fit.
+ * 
+ * @param[in] pk The public key, which must outlive the table
+ * @param[in] memory_budget The maximum size of the table in bytes, 0 for ENCRYPT_TABLE_DEFAULT_BUDGET
+ * @param[out] table Pointer to the table to initialize
+ * 
+ * @see EncryptTable
+*/
+void encrypt_table_init(PubKey pk, uint64_t memory_budget, EncryptTable* table);
+
+/**
+ * @brief Deletes the encryption table
+ * 
+ * @param[in] table The table to delete
+*/
+void encrypt_table_clear(EncryptTable table);
+
+/**
+ * @brief Encrypts a bit using an encryption table
+ * 
+ * The result is the same as the one of encrypt_bit with the public key of the table and the same part.
+ * 
+ * @param[in] bit The bit to be encrypted
+ * @param[in] table The encryption table
+ * @param[in] part The part to be encrypted
+ * @param[out] c The encrypted bit
+ * 
+ * @see EncryptTable
+ * @see encrypt_bit
+*/
+void encrypt_bit_table(bool bit, EncryptTable table, Part part, Polynomial_t* c);
+
 /**
  * @brief Decrypts a bit using the secret key
  * 
+ * The bit is the constant coefficient of the remainder of c divided by the secret key.
+ * 
  * @param[in] c The encrypted bit
  * @param[in] sk The secret key
  * @param[out] bit The decrypted bit
 */
 void decrypt_bit(Polynomial_t c, SecKey sk, bool* bit);
 
+/**
+ * @brief Sets the number of threads of the integer functions
+ * 
+ * encrypt, encrypt_many and decrypt share their bits between this many threads, the calling one included.
+ * The default is 1.
+ * 
+ * @param[in] n_threads The number of threads, 0 meaning 1
+*/
+void set_homomorph_threads(uint32_t n_threads);
+
+/**
+ * @brief Packs encrypted bits into an encrypted integer
+ * 
+ * The ciphertexts are copied into the single allocation of the integer, then deleted.
+ * The degree of the stats is the highest one of the bits, but their noise and depth are not known: they are 0, and are for the caller to set.
+ * 
+ * @param[in] bits The width encrypted bits, the least significant one first
+ * @param[in] width The number of bits
+ * @return The encrypted integer
+ * 
+ * @see CipheredInt
+*/
+CipheredInt ciphered_int(Polynomial_t* bits, uint32_t width);
+
+/**
+ * @brief Deletes an encrypted integer
+ * 
+ * @param[in] c The encrypted integer to delete
+*/
+void delete_ciphered_int(CipheredInt c);
+
+/**
+ * @brief Packs encrypted bits into a batch of encrypted integers
+ * 
+ * The ciphertexts are copied into the single allocation of the batch, then deleted.
+ * As with ciphered_int, only the degree of the stats is set.
+ * 
+ * @param[in] bits The width*count encrypted bits, bit i of integer k being bits[i*count + k]
+ * @param[in] width The number of bits of each integer
+ * @param[in] count The number of integers
+ * @return The batch
+ * 
+ * @see CipheredBatch
+*/
+CipheredBatch ciphered_batch(Polynomial_t* bits, uint32_t width, uint64_t count);
+
+/**
+ * @brief Deletes a batch of encrypted integers
+ * 
+ * @param[in] c The batch to delete
+*/
+void delete_ciphered_batch(CipheredBatch c);
+
 /**
  * @brief Encrypts an integer using the public key
  * 
- * @param[in] bit The bit to be encrypted
+ * @param[in] n The integer to be encrypted
+ * @param[in] width The number of bits to encrypt, at most CIPHERED_INT_MAX_WIDTH
  * @param[in] pk The public key
  * @param[out] c The encrypted integer
 */
-void encrypt(uint64_t n, PubKey pk, CipheredInt* c);
+void encrypt(uint64_t n, uint32_t width, PubKey pk, CipheredInt* c);
+
+/**
+ * @brief Encrypts many bits using the public key
+ * 
+ * Each bit gets its own random part, as with encrypt_bit.
+ * The ciphertexts are built by groups that fit in ENCRYPT_BATCH_BYTES, and the public key is read once per group instead of once per bit.
+ * 
+ * @param[in] bits The bits to be encrypted
+ * @param[in] n The number of bits
+ * @param[in] pk The public key
+ * @param[out] c The n encrypted bits
+*/
+void encrypt_bits(const bool* bits, uint64_t n, PubKey pk, Polynomial_t* c);
+
+/**
+ * @brief Encrypts many bits with given parts
+ * 
+ * This is encrypt_bits with the random parts drawn beforehand, so that drawing them and encrypting can run on different threads.
+ * The part of bit j is made of the first pk.size bits of the POL_WORDS(pk.size) words parts[j*POL_WORDS(pk.size)], the first element being the least significant bit.
+ * 
+ * @param[in] bits The bits to be encrypted
+ * @param[in] n The number of bits
+ * @param[in] pk The public key
+ * @param[in] parts The n parts, as random words
+ * @param[out] c The n encrypted bits
+ * 
+ * @see encrypt_bits
+*/
+void encrypt_bits_parts(const bool* bits, uint64_t n, PubKey pk, const pol_word_t* parts, Polynomial_t* c);
+
+/**
+ * @brief Encrypts many integers using the public key
+ * 
+ * All the bits of the integers are encrypted in a single batch.
+ * The integers get the noise of pk and a depth of 0, as do the ones of encrypt and encrypt_batch.
+ * 
+ * @param[in] n The integers to be encrypted
+ * @param[in] count The number of integers
+ * @param[in] width The number of bits to encrypt of each integer, at most CIPHERED_INT_MAX_WIDTH
+ * @param[in] pk The public key
+ * @param[out] c The count encrypted integers
+ * 
+ * @see encrypt_bits
+*/
+void encrypt_many(const uint64_t* n, uint64_t count, uint32_t width, PubKey pk, CipheredInt* c);
+
+/**
+ * @brief Encrypts many integers on a given number of threads
+ * 
+ * This is encrypt_many on n_threads threads, the calling one included, instead of the ones of set_homomorph_threads.
+ * Each thread draws from its own random stream and only reads pk, so several threads may encrypt with the same key at once.
+ * 
+ * @param[in] n The integers to be encrypted
+ * @param[in] count The number of integers
+ * @param[in] width The number of bits to encrypt of each integer, at most CIPHERED_INT_MAX_WIDTH
+ * @param[in] pk The public key
+ * @param[in] n_threads The number of threads, 0 and 1 both meaning the calling thread only
+ * @param[out] c The count encrypted integers
+ * 
+ * @see encrypt_many
+*/
+void encrypt_many_threads(const uint64_t* n, uint64_t count, uint32_t width, PubKey pk, uint32_t n_threads, CipheredInt* c);
 
 /**
  * @brief Decrypts an integer using the secret key
@@ -79,12 +342,183 @@ void encrypt(uint64_t n, PubKey pk, CipheredInt* c);
 */
 void decrypt(CipheredInt* c, SecKey sk, uint64_t* n);
 
+/**
+ * @brief Encrypts many integers into a batch
+ * 
+ * @param[in] n The integers to be encrypted
+ * @param[in] count The number of integers
+ * @param[in] width The number of bits to encrypt of each integer, at most CIPHERED_INT_MAX_WIDTH
+ * @param[in] pk The public key
+ * @param[out] c The batch of encrypted integers
+*/
+void encrypt_batch(const uint64_t* n, uint64_t count, uint32_t width, PubKey pk, CipheredBatch* c);
+
+/**
+ * @brief Decrypts a batch of integers using the secret key
+ * 
+ * @param[in] c The batch of encrypted integers
+ * @param[in] sk The secret key
+ * @param[out] n The c.count decrypted integers
+*/
+void decrypt_batch(CipheredBatch c, SecKey sk, uint64_t* n);
+
+/**
+ * @brief Precomputes the decryption of many ciphertexts under the same secret key
+ * 
+ * @param[in] sk The secret key, which must outlive the context
+ * @param[in] max_degree The highest ciphertext degree expected, at least the degree of sk
+ * @param[out] ctx Pointer to the context to initialize
+ * 
+ * @see DecryptContext
+*/
+void decrypt_context_init(SecKey sk, pol_degree_t max_degree, DecryptContext* ctx);
+
+/**
+ * @brief Deletes the decryption context
+ * 
+ * @param[in] ctx The context to delete
+*/
+void decrypt_context_clear(DecryptContext ctx);
+
+/**
+ * @brief Decrypts many bits using a decryption context
+ * 
+ * Ciphertexts of degree higher than ctx.max_degree are still decrypted, through a full division.
+ * 
+ * @param[in] c The encrypted bits
+ * @param[in] n The number of encrypted bits
+ * @param[in] ctx The decryption context
+ * @param[out] bits The n decrypted bits
+ * 
+ * @see DecryptContext
+*/
+void decrypt_bits(const Polynomial_t* c, uint64_t n, DecryptContext ctx, bool* bits);
+
+/**
+ * @brief Computes the OR of two encrypted bits
+ * 
+ * @param[in] a The first encrypted bit
+ * @param[in] b The second encrypted bit
+ * @param[out] c The encrypted result
+*/
+void ciphered_or_bit(Polynomial_t a, Polynomial_t b, Polynomial_t* c);
+
 /**
  * @brief Adds two encrypted integers
  * 
+ * The integers must have the same width, and the sum is taken modulo 2^width.
+ * The circuit adder is used if several threads are set by set_homomorph_threads, the ripple one otherwise.
+ * 
  * @param[in] a The first encrypted integer
  * @param[in] b The second encrypted integer
- * @param[in] pk The public key
  * @param[out] c The result of the addition
 */
-void ciphered_add(CipheredInt a, CipheredInt b, CipheredInt* c);
\ No newline at end of file
+void ciphered_add(CipheredInt a, CipheredInt b, CipheredInt* c);
+
+/**
+ * @brief Adds two encrypted integers with the given adder
+ * 
+ * The noise and the depth of the sum are the ones estimate_add predicts, worked out without building the adder as a circuit.
+ * 
+ * @param[in] a The first encrypted integer
+ * @param[in] b The second encrypted integer
+ * @param[in] adder The adder circuit
+ * @param[out] c The result of the addition
+ * 
+ * @see CipheredAdder
+*/
+void ciphered_add_with(CipheredInt a, CipheredInt b, CipheredAdder adder, CipheredInt* c);
+
+/**
+ * @brief Predicts an addition before running it
+ * 
+ * The adder is built as a Circuit and given to circuit_estimate with the stats of a and b.
+ * The stats are the ones ciphered_add_with would give, except for the degree, which is a bound: the real bits may have lower degrees.
+ * 
+ * @param[in] a The first encrypted integer
+ * @param[in] b The second encrypted integer
+ * @param[in] adder The adder circuit
+ * @param[out] stats The stats of the sum, may be NULL
+ * @param[out] cost The predicted cost of the addition on one thread, may be NULL
+ * 
+ * @see circuit_estimate
+*/
+void estimate_add(CipheredInt a, CipheredInt b, CipheredAdder adder, CipherStats* stats, CircuitCost* cost);
+
+/**
+ * @brief Gets the noise budget left to a ciphertext
+ * 
+ * Decryption is correct as long as the noise has a lower degree than the secret key.
+ * A product adds the noises of its factors, so two ciphertexts can be multiplied if the sum of their noises is below the degree of sk.
+ * 
+ * @param[in] stats The stats of the ciphertext
+ * @param[in] sk The secret key
+ * @return The degree of sk minus the noise, 0 if the ciphertext may already decrypt wrong
+*/
+pol_degree_t noise_budget(CipherStats stats, SecKey sk);
+
+/**
+ * @brief Adds two batches of encrypted integers
+ * 
+ * Integer k of c is the sum of integers k of a and b, modulo 2^width.
+ * The ripple adder is built once as a Circuit and evaluated on all the pairs by circuit_evaluate_batch.
+ * The pairs are shared between the threads set by set_homomorph_threads, so the adder with the fewest gates is the fastest one whatever the number of threads.
+ * 
+ * @param[in] a The first batch
+ * @param[in] b The second batch, of the same width and count
+ * @param[out] c The batch of the sums
+*/
+void ciphered_add_batch(CipheredBatch a, CipheredBatch b, CipheredBatch* c);
+
+/**
+ * @brief Multiplies two encrypted integers
+ * 
+ * The integers must have the same width, and the product is taken modulo 2^width.
+ * The partial products a_j*b_i are reduced by a Wallace tree: every layer turns each three bits of a column into a sum and a carry of the next column, in all the columns at once,
+ * until two rows are left, which a Kogge-Stone adder adds. The depth is logarithmic in the width: 7 products for a width of 8, 11 for 16 and 13 for 32.
+ * The multiplier is built as a Circuit and evaluated once, on the threads set by set_homomorph_threads.
+ * The carries multiply the degrees of their inputs, so the degree still grows fast with the width:
+ * for input bits of degree D, the product bits reach about 40*D for a width of 8, 370*D for 16 and 1700*D for 32.
+ * The stats of the product are the ones circuit_estimate predicts for the multiplier.
+ * 
+ * @param[in] a The first encrypted integer
+ * @param[in] b The second encrypted integer
+ * @param[out] c The result of the multiplication
+*/
+void ciphered_mul(CipheredInt a, CipheredInt b, CipheredInt* c);
+
+/**
+ * @brief Compares two encrypted integers for equality
+ * 
+ * The bits 1 + a_i + b_i are multiplied together by a balanced tree, of depth log2(width).
+ * For input bits of degree D, the result has a degree of at most width*D, and so has the noise for input bits of noise D.
+ * 
+ * @param[in] a The first encrypted integer
+ * @param[in] b The second encrypted integer
+ * @param[out] c The encrypted bit a == b, as an integer of width 1
+*/
+void ciphered_equal(CipheredInt a, CipheredInt b, CipheredInt* c);
+
+/**
+ * @brief Compares two encrypted integers
+ * 
+ * The integers are unsigned. The (less than, equal) pairs of the bits are combined by a balanced tree, of depth log2(width).
+ * For input bits of degree D, the result has a degree of at most (width+1)*D, and so has the noise for input bits of noise D.
+ * 
+ * @param[in] a The first encrypted integer
+ * @param[in] b The second encrypted integer
+ * @param[out] c The encrypted bit a < b, as an integer of width 1
+*/
+void ciphered_less_than(CipheredInt a, CipheredInt b, CipheredInt* c);
+
+/**
+ * @brief Selects one of two encrypted integers
+ * 
+ * Each bit is b_i + s(a_i + b_i), whose degree is the degree of s plus the one of the input bits, and so is the noise.
+ * 
+ * @param[in] s The encrypted selector, an integer of width 1 such as the result of a comparison
+ * @param[in] a The encrypted integer selected if s is 1
+ * @param[in] b The encrypted integer selected if s is 0
+ * @param[out] c The selected encrypted integer
+*/
+void ciphered_select(CipheredInt s, CipheredInt a, CipheredInt b, CipheredInt* c);
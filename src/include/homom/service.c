@@ -0,0 +1,145 @@
+#include "service.h"
+
+#include <unistd.h>
+
+#include "pool.h"
+
+
+// Takes the first request of q, NULL if it is empty
+static EncryptRequest* pop_request(EncryptQueue* q) {
+    pthread_mutex_lock(&q->mutex);
+    EncryptRequest* r = q->head;
+    if (r != NULL) {
+        q->head = r->next;
+        if (q->head == NULL) q->tail = NULL;
+        __atomic_fetch_sub(&q->service->pending, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return r;
+}
+
+// A request of the queue of the worker index, else of the others in turn
+static EncryptRequest* take_request(EncryptService* s, uint32_t index) {
+    for (uint32_t k = 0; k < s->n_threads; k++) {
+        EncryptRequest* r = pop_request(&s->queues[(index + k) % s->n_threads]);
+        if (r != NULL) return r;
+    }
+    return NULL;
+}
+
+static void run_request(EncryptService* s, EncryptRequest* r) {
+    encrypt_many_threads(r->n, r->count, r->width, s->pk, 1, r->c);
+    // The producer waits on the queue it submitted to, whichever worker ran the request
+    EncryptQueue* home = &s->queues[r->queue];
+    pthread_mutex_lock(&home->mutex);
+    r->done = true;
+    pthread_cond_broadcast(&home->done);
+    pthread_mutex_unlock(&home->mutex);
+}
+
+static void* worker_thread(void* arg) {
+    EncryptQueue* q = (EncryptQueue*) arg;
+    EncryptService* s = q->service;
+    for (;;) {
+        EncryptRequest* r = take_request(s, q->index);
+        if (r != NULL) {
+            run_request(s, r);
+            continue;
+        }
+
+        // A request queued anywhere wakes the worker, so a backlog never waits behind a long request
+        pthread_mutex_lock(&s->mutex);
+        while (__atomic_load_n(&s->pending, __ATOMIC_RELAXED) == 0 && !s->stopping) pthread_cond_wait(&s->ready, &s->mutex);
+        bool done = __atomic_load_n(&s->pending, __ATOMIC_RELAXED) == 0 && s->stopping;
+        pthread_mutex_unlock(&s->mutex);
+        if (done) break;
+    }
+    // The temporaries cached by this thread would be lost when it exits
+    pol_pool_trim();
+    return NULL;
+}
+
+void encrypt_service_start(PubKey pk, uint32_t n_threads, EncryptService* s) {
+    if (s == NULL) exit(1);
+    if (n_threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = n > 0 ? (uint32_t)n : 1;
+    }
+    s->pk = pk;
+    s->n_threads = n_threads;
+    s->next = 0;
+    s->pending = 0;
+    s->stopping = false;
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->ready, NULL);
+    s->threads = (pthread_t*) malloc(n_threads*sizeof(pthread_t));
+    s->queues = (EncryptQueue*) calloc(n_threads, sizeof(EncryptQueue));
+    if (s->threads == NULL || s->queues == NULL) exit(1);
+    for (uint32_t t = 0; t < n_threads; t++) {
+        EncryptQueue* q = &s->queues[t];
+        q->service = s;
+        q->index = t;
+        pthread_mutex_init(&q->mutex, NULL);
+        pthread_cond_init(&q->done, NULL);
+    }
+    for (uint32_t t = 0; t < n_threads; t++) {
+        if (pthread_create(&s->threads[t], NULL, worker_thread, &s->queues[t]) != 0) exit(1);
+    }
+}
+
+void encrypt_service_stop(EncryptService* s) {
+    if (s == NULL) exit(1);
+    pthread_mutex_lock(&s->mutex);
+    s->stopping = true;
+    pthread_cond_broadcast(&s->ready);
+    pthread_mutex_unlock(&s->mutex);
+    for (uint32_t t = 0; t < s->n_threads; t++) pthread_join(s->threads[t], NULL);
+    for (uint32_t t = 0; t < s->n_threads; t++) {
+        EncryptQueue* q = &s->queues[t];
+        pthread_cond_destroy(&q->done);
+        pthread_mutex_destroy(&q->mutex);
+    }
+    pthread_cond_destroy(&s->ready);
+    pthread_mutex_destroy(&s->mutex);
+    free(s->queues);
+    free(s->threads);
+    *s = (EncryptService){0};
+}
+
+EncryptRequest encrypt_request(const uint64_t* n, uint64_t count, uint32_t width, CipheredInt* c) {
+    if (width > CIPHERED_INT_MAX_WIDTH) exit(1);
+    return (EncryptRequest){n, count, width, c, 0, false, NULL};
+}
+
+void encrypt_service_submit(EncryptService* s, EncryptRequest* r) {
+    if (s == NULL || r == NULL) exit(1);
+    if (r->width > CIPHERED_INT_MAX_WIDTH) exit(1);
+    r->queue = __atomic_fetch_add(&s->next, 1, __ATOMIC_RELAXED) % s->n_threads;
+    r->done = false;
+    r->next = NULL;
+    EncryptQueue* q = &s->queues[r->queue];
+    pthread_mutex_lock(&q->mutex);
+    if (q->tail != NULL) q->tail->next = r;
+    else q->head = r;
+    q->tail = r;
+    __atomic_fetch_add(&s->pending, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&q->mutex);
+    // Counted before the lock of the idle workers is taken, so a worker about to wait sees it
+    pthread_mutex_lock(&s->mutex);
+    pthread_cond_signal(&s->ready);
+    pthread_mutex_unlock(&s->mutex);
+}
+
+void encrypt_service_wait(EncryptService* s, EncryptRequest* r) {
+    if (s == NULL || r == NULL) exit(1);
+    EncryptQueue* q = &s->queues[r->queue];
+    pthread_mutex_lock(&q->mutex);
+    while (!r->done) pthread_cond_wait(&q->done, &q->mutex);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+void encrypt_service_encrypt(EncryptService* s, const uint64_t* n, uint64_t count, uint32_t width, CipheredInt* c) {
+    EncryptRequest r = encrypt_request(n, count, width, c);
+    encrypt_service_submit(s, &r);
+    encrypt_service_wait(s, &r);
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "homomorph.h"
+
+
+/**
+ * @file service.h
+ * @brief Encryption service shared by many threads.
+ *
+ * A service owns a pool of worker threads that encrypt integers with one public key, on behalf of any number of producer threads.
+ * Each worker has its own queue, and the requests are dealt to the queues in turn, so producers rarely wait for the same lock;
+ * a worker whose queue is empty takes the requests left in the others, and every request wakes an idle worker, whichever queue it went to.
+ * The workers only read the public key, and each one draws its random parts from its own ChaCha20 stream.
+ *
+ * @see EncryptService
+*/
+
+
+/**
+ * @brief Request of encryption
+ *
+ * The request belongs to its producer, which must keep it and its arrays alive until encrypt_service_wait returns.
+ *
+ * @param n The integers to be encrypted.
+ * @param count The number of integers.
+ * @param width The number of bits to encrypt of each integer.
+ * @param c The count encrypted integers, written by the service.
+ * @param queue Queue of the request, set by encrypt_service_submit.
+ * @param done Whether the integers are encrypted, guarded by the lock of the queue.
+ * @param next Next request of the queue.
+ *
+ * @see encrypt_request
+*/
+typedef struct EncryptRequest {
+    const uint64_t* n;
+    uint64_t count;
+    uint32_t width;
+    CipheredInt* c;
+    uint32_t queue;
+    bool done;
+    struct EncryptRequest* next;
+} EncryptRequest;
+
+/**
+ * @brief Queue of a worker
+ *
+ * @param service The service of the worker.
+ * @param index The index of the worker.
+ * @param mutex Lock of the requests and of their done flags.
+ * @param done Signaled when a request of the queue is done.
+ * @param head First request waiting, NULL if none.
+ * @param tail Last request waiting.
+*/
+typedef struct EncryptQueue {
+    struct EncryptService* service;
+    uint32_t index;
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+    EncryptRequest* head;
+    EncryptRequest* tail;
+} EncryptQueue;
+
+/**
+ * @brief Encryption service
+ *
+ * The service must stay at the same address from encrypt_service_start to encrypt_service_stop.
+ *
+ * @param pk The public key, which must outlive the service.
+ * @param n_threads The number of workers.
+ * @param threads The workers.
+ * @param queues The queue of each worker.
+ * @param next Counter dealing the requests to the queues.
+ * @param pending The number of requests waiting in all the queues, updated under the lock of their queue.
+ * @param mutex Lock of the idle workers.
+ * @param ready Signaled when a request is queued or the service stops.
+ * @param stopping Whether the workers must exit once the queues are empty, guarded by mutex.
+ *
+ * @see encrypt_service_start
+*/
+typedef struct EncryptService {
+    PubKey pk;
+    uint32_t n_threads;
+    pthread_t* threads;
+    EncryptQueue* queues;
+    uint32_t next;
+    uint64_t pending;
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+    bool stopping;
+} EncryptService;
+
+/**
+ * @brief Starts an encryption service
+ *
+ * @param[in] pk The public key
+ * @param[in] n_threads The number of workers, 0 meaning one per online processor
+ * @param[out] s Pointer to the service
+*/
+void encrypt_service_start(PubKey pk, uint32_t n_threads, EncryptService* s);
+
+/**
+ * @brief Stops an encryption service
+ *
+ * The requests already submitted are encrypted before the workers exit.
+ * No request may be submitted anymore.
+ *
+ * @param[in,out] s Pointer to the service
+*/
+void encrypt_service_stop(EncryptService* s);
+
+/**
+ * @brief Creates a request of encryption
+ *
+ * @param[in] n The integers to be encrypted
+ * @param[in] count The number of integers
+ * @param[in] width The number of bits to encrypt of each integer, at most CIPHERED_INT_MAX_WIDTH
+ * @param[out] c The count encrypted integers, valid once the request is done
+ * @return The request
+*/
+EncryptRequest encrypt_request(const uint64_t* n, uint64_t count, uint32_t width, CipheredInt* c);
+
+/**
+ * @brief Submits a request
+ *
+ * This function returns at once, and may be called from any thread.
+ * The integers are encrypted as by encrypt_many.
+ *
+ * @param[in,out] s Pointer to the service
+ * @param[in,out] r Pointer to the request
+*/
+void encrypt_service_submit(EncryptService* s, EncryptRequest* r);
+
+/**
+ * @brief Waits for a request to be done
+ *
+ * @param[in,out] s Pointer to the service
+ * @param[in] r Pointer to a submitted request
+*/
+void encrypt_service_wait(EncryptService* s, EncryptRequest* r);
+
+/**
+ * @brief Encrypts integers with the service
+ *
+ * This function submits a request and waits for it.
+ *
+ * @param[in,out] s Pointer to the service
+ * @param[in] n The integers to be encrypted
+ * @param[in] count The number of integers
+ * @param[in] width The number of bits to encrypt of each integer, at most CIPHERED_INT_MAX_WIDTH
+ * @param[out] c The count encrypted integers
+*/
+void encrypt_service_encrypt(EncryptService* s, const uint64_t* n, uint64_t count, uint32_t width, CipheredInt* c);
@@ -0,0 +1,295 @@
+#include "storage.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define BYTE_ORDER_MARK 0x0102
+
+static const char magic[8] = {'H', 'O', 'M', 'O', 'M', 'P', 'O', 'L'};
+
+// Fixed-width fields, so that the layout does not depend on the compiler
+// The fields that a kind does not use are 0
+typedef struct {
+    char magic[8];
+    uint16_t version;
+    uint16_t byte_order;
+    uint32_t kind;
+    uint64_t n_polynoms;
+    uint64_t n_stats;
+    uint64_t count;
+    uint32_t width;
+    uint32_t d;
+    uint32_t dp;
+    uint32_t delta;
+    uint32_t noise;
+    uint32_t reserved;
+} FileHeader;
+
+typedef struct {
+    uint32_t degree;
+    uint32_t noise;
+    uint32_t depth;
+    uint32_t reserved;
+} FileStats;
+
+// Offset in bytes from the start of the file
+typedef struct {
+    uint64_t offset;
+    uint32_t degree;
+    uint32_t reserved;
+} FileEntry;
+
+_Static_assert(sizeof(FileHeader) == 64, "FileHeader must not be padded");
+
+
+static inline uint64_t align(uint64_t offset) {
+    return (offset + HOMOM_FILE_ALIGNMENT-1) / HOMOM_FILE_ALIGNMENT * HOMOM_FILE_ALIGNMENT;
+}
+
+static void write_bytes(FILE* file, const void* data, uint64_t n) {
+    if (n > 0 && fwrite(data, 1, n, file) != n) exit(EXIT_BAD_FILE);
+}
+
+// The header, the stats and the table, then the words of each polynom from an aligned offset
+static void write_file(const char* path, FileHeader header, const FileStats* stats, const Polynomial_t* polynoms) {
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = HOMOM_FILE_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    FileEntry* table = (FileEntry*) malloc(MAX(header.n_polynoms, 1)*sizeof(FileEntry));
+    if (table == NULL) exit(1);
+    uint64_t offset = align(sizeof(FileHeader) + header.n_stats*sizeof(FileStats) + header.n_polynoms*sizeof(FileEntry));
+    for (uint64_t i = 0; i < header.n_polynoms; i++) {
+        table[i] = (FileEntry){offset, polynoms[i].degree, 0};
+        offset = align(offset + POL_WORDS(polynoms[i].degree + 1)*sizeof(pol_word_t));
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) exit(EXIT_BAD_FILE);
+    write_bytes(file, &header, sizeof(header));
+    if (stats != NULL) write_bytes(file, stats, header.n_stats*sizeof(FileStats));
+    write_bytes(file, table, header.n_polynoms*sizeof(FileEntry));
+    static const uint8_t zeros[HOMOM_FILE_ALIGNMENT] = {0};
+    uint64_t position = sizeof(FileHeader) + header.n_stats*sizeof(FileStats) + header.n_polynoms*sizeof(FileEntry);
+    for (uint64_t i = 0; i < header.n_polynoms; i++) {
+        write_bytes(file, zeros, table[i].offset - position);
+        uint64_t n = POL_WORDS(polynoms[i].degree + 1)*sizeof(pol_word_t);
+        write_bytes(file, polynoms[i].coefficients, n);
+        position = table[i].offset + n;
+    }
+    write_bytes(file, zeros, align(position) - position);
+    if (fclose(file) != 0) exit(EXIT_BAD_FILE);
+    free(table);
+}
+
+void write_context(const char* path, HomomContext ctx) {
+    Polynomial_t* polynoms = (Polynomial_t*) malloc((ctx.pk.size + 1)*sizeof(Polynomial_t));
+    if (polynoms == NULL) exit(1);
+    polynoms[0] = ctx.sk;
+    memcpy(polynoms + 1, ctx.pk.elements, ctx.pk.size*sizeof(Polynomial_t));
+    FileHeader header = {0};
+    header.kind = HOMOM_FILE_CONTEXT;
+    header.n_polynoms = ctx.pk.size + 1;
+    header.d = ctx.d;
+    header.dp = ctx.dp;
+    header.delta = ctx.delta;
+    header.noise = ctx.pk.noise;
+    write_file(path, header, NULL, polynoms);
+    free(polynoms);
+}
+
+void write_public_key(const char* path, PubKey pk) {
+    FileHeader header = {0};
+    header.kind = HOMOM_FILE_PUBLIC_KEY;
+    header.n_polynoms = pk.size;
+    header.noise = pk.noise;
+    write_file(path, header, NULL, pk.elements);
+}
+
+void write_secret_key(const char* path, SecKey sk) {
+    FileHeader header = {0};
+    header.kind = HOMOM_FILE_SECRET_KEY;
+    header.n_polynoms = 1;
+    write_file(path, header, NULL, &sk);
+}
+
+void write_ciphered_ints(const char* path, const CipheredInt* c, uint64_t count) {
+    uint32_t width = count > 0 ? c[0].width : 0;
+    FileStats* stats = (FileStats*) malloc(MAX(count, 1)*sizeof(FileStats));
+    Polynomial_t* polynoms = (Polynomial_t*) malloc(MAX(count*width, 1)*sizeof(Polynomial_t));
+    if (stats == NULL || polynoms == NULL) exit(1);
+    for (uint64_t k = 0; k < count; k++) {
+        if (c[k].width != width) exit(1);
+        stats[k] = (FileStats){c[k].stats.degree, c[k].stats.noise, c[k].stats.depth, 0};
+        memcpy(polynoms + k*width, c[k].elements, width*sizeof(Polynomial_t));
+    }
+    FileHeader header = {0};
+    header.kind = HOMOM_FILE_CIPHERED_INTS;
+    header.n_polynoms = count*width;
+    header.n_stats = count;
+    header.count = count;
+    header.width = width;
+    write_file(path, header, stats, polynoms);
+    free(polynoms);
+    free(stats);
+}
+
+void write_ciphered_batch(const char* path, CipheredBatch c) {
+    FileStats stats = {c.stats.degree, c.stats.noise, c.stats.depth, 0};
+    FileHeader header = {0};
+    header.kind = HOMOM_FILE_CIPHERED_BATCH;
+    header.n_polynoms = c.count*c.width;
+    header.n_stats = 1;
+    header.count = c.count;
+    header.width = c.width;
+    write_file(path, header, &stats, c.elements);
+}
+
+
+static inline const FileHeader* file_header(HomomFile f) {
+    return (const FileHeader*) f.data;
+}
+
+static inline const FileStats* file_stats(HomomFile f) {
+    return (const FileStats*)(f.data + sizeof(FileHeader));
+}
+
+static inline const FileEntry* file_table(HomomFile f) {
+    return (const FileEntry*)(file_stats(f) + file_header(f)->n_stats);
+}
+
+// Read-only view on polynom i, borrowing the words of the mapping
+static inline Polynomial_t file_polynom(HomomFile f, uint64_t i) {
+    FileEntry entry = file_table(f)[i];
+    return (Polynomial_t){(pol_word_t*)(uintptr_t)(f.data + entry.offset), entry.degree, 0};
+}
+
+// Everything the views rely on: the tables and the polynoms lie in the file, and the top word of each polynom matches its degree
+static bool valid_file(HomomFile f) {
+    if (f.length < sizeof(FileHeader)) return false;
+    const FileHeader* header = file_header(f);
+    if (memcmp(header->magic, magic, sizeof(magic)) != 0) return false;
+    if (header->version != HOMOM_FILE_VERSION || header->byte_order != BYTE_ORDER_MARK) return false;
+    if (header->kind > HOMOM_FILE_CIPHERED_BATCH) return false;
+    uint64_t space = f.length - sizeof(FileHeader);
+    if (header->n_stats > space / sizeof(FileStats)) return false;
+    space -= header->n_stats*sizeof(FileStats);
+    if (header->n_polynoms > space / sizeof(FileEntry)) return false;
+
+    uint64_t n = header->n_polynoms;
+    switch (header->kind) {
+        case HOMOM_FILE_CONTEXT:
+            if (n == 0 || header->n_stats != 0) return false;
+            break;
+        case HOMOM_FILE_PUBLIC_KEY:
+            if (header->n_stats != 0) return false;
+            break;
+        case HOMOM_FILE_SECRET_KEY:
+            if (n != 1 || header->n_stats != 0) return false;
+            break;
+        case HOMOM_FILE_CIPHERED_INTS:
+        case HOMOM_FILE_CIPHERED_BATCH:
+            if (header->width > CIPHERED_INT_MAX_WIDTH) return false;
+            if (header->n_stats != (header->kind == HOMOM_FILE_CIPHERED_INTS ? header->count : 1)) return false;
+            if (header->width > 0 && header->count > n / header->width) return false;
+            if (n != header->count*header->width) return false;
+            break;
+    }
+
+    const FileEntry* table = file_table(f);
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t words = POL_WORDS((uint64_t)table[i].degree + 1);
+        if (table[i].offset % HOMOM_FILE_ALIGNMENT != 0 || table[i].offset > f.length) return false;
+        if (words > (f.length - table[i].offset) / sizeof(pol_word_t)) return false;
+        pol_word_t top = file_polynom(f, i).coefficients[words-1];
+        uint8_t bit = table[i].degree % POL_WORD_BITS;
+        if (bit < POL_WORD_BITS-1 && (top >> (bit+1)) != 0) return false;
+        // Only the null polynom has a degree whose coefficient is 0
+        if (!((top >> bit) & 1) && (table[i].degree != 0 || top != 0)) return false;
+    }
+    return true;
+}
+
+void homom_file_open(const char* path, HomomFile* f) {
+    if (f == NULL) exit(1);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) exit(EXIT_BAD_FILE);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(FileHeader)) exit(EXIT_BAD_FILE);
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file open
+    close(fd);
+    if (data == MAP_FAILED) exit(EXIT_BAD_FILE);
+    *f = (HomomFile){(const uint8_t*) data, (uint64_t) st.st_size, 0};
+    if (!valid_file(*f)) exit(EXIT_BAD_FILE);
+    f->kind = (HomomFileKind) file_header(*f)->kind;
+}
+
+void homom_file_close(HomomFile f) {
+    munmap((void*)(uintptr_t)f.data, f.length);
+}
+
+void read_context(HomomFile f, HomomContext* ctx) {
+    if (ctx == NULL) exit(1);
+    if (f.kind != HOMOM_FILE_CONTEXT) exit(EXIT_BAD_FILE);
+    const FileHeader* header = file_header(f);
+    read_secret_key(f, &ctx->sk);
+    read_public_key(f, &ctx->pk);
+    ctx->d = header->d;
+    ctx->dp = header->dp;
+    ctx->delta = header->delta;
+    ctx->tau = ctx->pk.size;
+}
+
+void read_public_key(HomomFile f, PubKey* pk) {
+    if (pk == NULL) exit(1);
+    if (f.kind != HOMOM_FILE_PUBLIC_KEY && f.kind != HOMOM_FILE_CONTEXT) exit(EXIT_BAD_FILE);
+    // The secret key comes first in a context
+    uint64_t first = f.kind == HOMOM_FILE_CONTEXT ? 1 : 0;
+    pk->size = file_header(f)->n_polynoms - first;
+    pk->noise = file_header(f)->noise;
+    pk->elements = (Polynomial_t*) malloc(MAX(pk->size, 1)*sizeof(Polynomial_t));
+    if (pk->elements == NULL) exit(1);
+    for (uint64_t i = 0; i < pk->size; i++) pk->elements[i] = file_polynom(f, first + i);
+}
+
+void read_secret_key(HomomFile f, SecKey* sk) {
+    if (sk == NULL) exit(1);
+    if (f.kind != HOMOM_FILE_SECRET_KEY && f.kind != HOMOM_FILE_CONTEXT) exit(EXIT_BAD_FILE);
+    *sk = file_polynom(f, 0);
+}
+
+uint64_t ciphered_ints_count(HomomFile f) {
+    if (f.kind != HOMOM_FILE_CIPHERED_INTS) exit(EXIT_BAD_FILE);
+    return file_header(f)->count;
+}
+
+void read_ciphered_ints(HomomFile f, CipheredInt* c) {
+    uint64_t count = ciphered_ints_count(f);
+    uint32_t width = file_header(f)->width;
+    const FileStats* stats = file_stats(f);
+    for (uint64_t k = 0; k < count; k++) {
+        c[k].elements = (Polynomial_t*) malloc(MAX(width, 1)*sizeof(Polynomial_t));
+        if (c[k].elements == NULL) exit(1);
+        for (uint32_t i = 0; i < width; i++) c[k].elements[i] = file_polynom(f, k*width + i);
+        c[k].width = width;
+        c[k].stats = (CipherStats){stats[k].degree, stats[k].noise, stats[k].depth};
+    }
+}
+
+void read_ciphered_batch(HomomFile f, CipheredBatch* c) {
+    if (c == NULL) exit(1);
+    if (f.kind != HOMOM_FILE_CIPHERED_BATCH) exit(EXIT_BAD_FILE);
+    const FileHeader* header = file_header(f);
+    uint64_t n = header->n_polynoms;
+    c->elements = (Polynomial_t*) malloc(MAX(n, 1)*sizeof(Polynomial_t));
+    if (c->elements == NULL) exit(1);
+    for (uint64_t i = 0; i < n; i++) c->elements[i] = file_polynom(f, i);
+    c->width = header->width;
+    c->count = header->count;
+    c->stats = (CipherStats){file_stats(f)->degree, file_stats(f)->noise, file_stats(f)->depth};
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "homomorph.h"
+
+#define HOMOM_FILE_VERSION 1
+// Coefficients start on cache lines, which is also the alignment of the widest vector kernels
+#define HOMOM_FILE_ALIGNMENT 64
+
+#define EXIT_BAD_FILE 6
+
+
+/**
+ * @file storage.h
+ * @brief Binary files of keys and ciphertexts.
+ *
+ * A file holds one kind of object: a whole context, a public key, a secret key, encrypted integers or a batch.
+ * It starts with a header and tables, followed by the coefficients of every polynom, each one aligned on HOMOM_FILE_ALIGNMENT bytes and stored as in memory.
+ * Opening a file maps it read-only, and the objects read from it are views on the mapping: their polynoms borrow its words, so nothing is copied nor parsed,
+ * and the processes that open the same file share its pages.
+ * The words are in the byte order of the machine that wrote them, and a file written on a machine of the other order is rejected.
+ * Any error, from the system or from a malformed file, exits with EXIT_BAD_FILE.
+ *
+ * @see HomomFile
+*/
+
+
+/**
+ * @brief Kinds of objects of a file
+*/
+typedef enum {
+    HOMOM_FILE_CONTEXT,
+    HOMOM_FILE_PUBLIC_KEY,
+    HOMOM_FILE_SECRET_KEY,
+    HOMOM_FILE_CIPHERED_INTS,
+    HOMOM_FILE_CIPHERED_BATCH
+} HomomFileKind;
+
+/**
+ * @brief Mapped file
+ *
+ * The objects read from the file are valid until it is closed.
+ *
+ * @param data Start of the mapping.
+ * @param length Length of the file in bytes.
+ * @param kind Kind of the objects of the file.
+ *
+ * @see homom_file_open
+*/
+typedef struct {
+    const uint8_t* data;
+    uint64_t length;
+    HomomFileKind kind;
+} HomomFile;
+
+/**
+ * @brief Writes a context
+ *
+ * @param[in] path The file to create or replace
+ * @param[in] ctx The context, both keys included
+*/
+void write_context(const char* path, HomomContext ctx);
+
+/**
+ * @brief Writes a public key
+ *
+ * @param[in] path The file to create or replace
+ * @param[in] pk The public key
+*/
+void write_public_key(const char* path, PubKey pk);
+
+/**
+ * @brief Writes a secret key
+ *
+ * @param[in] path The file to create or replace
+ * @param[in] sk The secret key
+*/
+void write_secret_key(const char* path, SecKey sk);
+
+/**
+ * @brief Writes encrypted integers
+ *
+ * The integers must have the same width, and keep their stats.
+ *
+ * @param[in] path The file to create or replace
+ * @param[in] c The encrypted integers
+ * @param[in] count The number of integers
+*/
+void write_ciphered_ints(const char* path, const CipheredInt* c, uint64_t count);
+
+/**
+ * @brief Writes a batch of encrypted integers
+ *
+ * @param[in] path The file to create or replace
+ * @param[in] c The batch
+*/
+void write_ciphered_batch(const char* path, CipheredBatch c);
+
+/**
+ * @brief Maps a file
+ *
+ * The header and the tables are checked, as well as the top word of each polynom, so that the views satisfy the invariants of Polynomial_t.
+ * The other words are not read before they are used.
+ *
+ * @param[in] path The file to open
+ * @param[out] f Pointer to the mapped file
+*/
+void homom_file_open(const char* path, HomomFile* f);
+
+/**
+ * @brief Unmaps a file
+ *
+ * @param[in] f The file to close, none of whose objects may be used anymore
+*/
+void homom_file_close(HomomFile f);
+
+/**
+ * @brief Reads a context
+ *
+ * The keys are views on the file, which must be a context file.
+ * The context is deleted by homomorph_clear, which frees the array of the public key elements and leaves the file alone.
+ *
+ * @param[in] f The mapped file
+ * @param[out] ctx Pointer to the context
+*/
+void read_context(HomomFile f, HomomContext* ctx);
+
+/**
+ * @brief Reads a public key
+ *
+ * The file must be a public key or a context file.
+ * The elements are views on the file, in an array to free once the key is no longer needed.
+ *
+ * @param[in] f The mapped file
+ * @param[out] pk Pointer to the public key
+*/
+void read_public_key(HomomFile f, PubKey* pk);
+
+/**
+ * @brief Reads a secret key
+ *
+ * The file must be a secret key or a context file.
+ *
+ * @param[in] f The mapped file
+ * @param[out] sk Pointer to the secret key, a view on the file
+*/
+void read_secret_key(HomomFile f, SecKey* sk);
+
+/**
+ * @brief Gets the number of encrypted integers of a file
+ *
+ * @param[in] f The mapped file, of encrypted integers
+ * @return The number of integers
+*/
+uint64_t ciphered_ints_count(HomomFile f);
+
+/**
+ * @brief Reads encrypted integers
+ *
+ * Each integer is deleted by delete_ciphered_int, which frees its elements and leaves the file alone.
+ *
+ * @param[in] f The mapped file, of encrypted integers
+ * @param[out] c The ciphered_ints_count(f) encrypted integers
+*/
+void read_ciphered_ints(HomomFile f, CipheredInt* c);
+
+/**
+ * @brief Reads a batch of encrypted integers
+ *
+ * The batch is deleted by delete_ciphered_batch, which frees its elements and leaves the file alone.
+ *
+ * @param[in] f The mapped file, of a batch
+ * @param[out] c Pointer to the batch
+*/
+void read_ciphered_batch(HomomFile f, CipheredBatch* c);
@@ -0,0 +1,320 @@
+#include "stream.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "random.h"
+
+
+#define BYTE_ORDER_MARK 0x0102
+#define CHUNK_BITS (8*STREAM_CHUNK_BYTES)
+#define STAGES 3
+
+static const char magic[8] = {'H', 'O', 'M', 'O', 'M', 'S', 'T', 'R'};
+
+typedef struct {
+    char magic[8];
+    uint16_t version;
+    uint16_t byte_order;
+    uint32_t reserved;
+} StreamHeader;
+
+typedef struct {
+    uint64_t n_bytes;
+    uint64_t payload_bytes;
+} FrameHeader;
+
+// A chunk with no plain byte is the last one of the stream
+typedef struct {
+    uint8_t plain[STREAM_CHUNK_BYTES];
+    uint64_t n_bytes;
+    bool bits[CHUNK_BITS];
+    Polynomial_t ciphers[CHUNK_BITS];
+    uint64_t n_ciphers;
+    pol_word_t* parts;
+    // Serialized frame, or payload of a read frame
+    uint8_t* frame;
+    uint64_t frame_length;
+    uint64_t frame_capacity;
+    // Stage that may work on the chunk next
+    uint8_t stage;
+} Chunk;
+
+typedef struct {
+    void (*stages[STAGES])(void* stream, Chunk* chunk);
+    void* stream;
+    Chunk* chunks;
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+} Pipeline;
+
+typedef struct {
+    Pipeline* pipeline;
+    uint8_t stage;
+} StageTask;
+
+
+// Stage s takes the chunks in turn, each one once the previous stage has handed it over
+static void run_stage(Pipeline* p, uint8_t s) {
+    for (uint64_t i = 0;; i++) {
+        Chunk* chunk = &p->chunks[i % STREAM_SLOTS];
+        pthread_mutex_lock(&p->mutex);
+        while (chunk->stage != s) pthread_cond_wait(&p->ready, &p->mutex);
+        pthread_mutex_unlock(&p->mutex);
+
+        p->stages[s](p->stream, chunk);
+        // The chunk belongs to the next stage as soon as it is handed over
+        bool last = chunk->n_bytes == 0;
+        pthread_mutex_lock(&p->mutex);
+        chunk->stage = (s+1) % STAGES;
+        pthread_cond_broadcast(&p->ready);
+        pthread_mutex_unlock(&p->mutex);
+        if (last) return;
+    }
+}
+
+static void* stage_thread(void* arg) {
+    StageTask* task = (StageTask*) arg;
+    run_stage(task->pipeline, task->stage);
+    // The temporaries cached by this thread would be lost when it exits
+    pol_pool_trim();
+    return NULL;
+}
+
+// The calling thread runs the first stage
+static void run_pipeline(Pipeline* p) {
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->ready, NULL);
+    StageTask tasks[STAGES];
+    pthread_t threads[STAGES];
+    for (uint8_t s = 1; s < STAGES; s++) {
+        tasks[s] = (StageTask){p, s};
+        if (pthread_create(&threads[s], NULL, stage_thread, &tasks[s]) != 0) exit(1);
+    }
+    run_stage(p, 0);
+    for (uint8_t s = 1; s < STAGES; s++) pthread_join(threads[s], NULL);
+    pthread_cond_destroy(&p->ready);
+    pthread_mutex_destroy(&p->mutex);
+}
+
+static Chunk* new_chunks(void) {
+    Chunk* chunks = (Chunk*) calloc(STREAM_SLOTS, sizeof(Chunk));
+    if (chunks == NULL) exit(1);
+    return chunks;
+}
+
+static void delete_chunks(Chunk* chunks) {
+    for (uint32_t i = 0; i < STREAM_SLOTS; i++) {
+        free(chunks[i].parts);
+        free(chunks[i].frame);
+    }
+    free(chunks);
+}
+
+static void reserve_frame(Chunk* chunk, uint64_t n) {
+    if (n <= chunk->frame_capacity) return;
+    uint8_t* frame = (uint8_t*) realloc(chunk->frame, n);
+    if (frame == NULL) exit(1);
+    chunk->frame = frame;
+    chunk->frame_capacity = n;
+}
+
+// Reads up to n bytes, fewer only at the end of the source
+static uint64_t read_full(ByteSource in, uint8_t* buffer, uint64_t n) {
+    uint64_t done = 0;
+    while (done < n) {
+        uint64_t r = in.read(in.state, buffer + done, n - done);
+        if (r == 0) break;
+        done += r;
+    }
+    return done;
+}
+
+static void read_exact(ByteSource in, void* buffer, uint64_t n) {
+    if (read_full(in, (uint8_t*) buffer, n) != n) exit(EXIT_BAD_STREAM);
+}
+
+
+typedef struct {
+    ByteSource in;
+    PubKey pk;
+    ByteSink out;
+    uint64_t part_words;
+    bool end;
+    uint64_t total;
+} Encoder;
+
+static void read_plain(void* stream, Chunk* chunk) {
+    Encoder* e = (Encoder*) stream;
+    chunk->n_bytes = e->end ? 0 : read_full(e->in, chunk->plain, STREAM_CHUNK_BYTES);
+    if (chunk->n_bytes < STREAM_CHUNK_BYTES) e->end = true;
+    e->total += chunk->n_bytes;
+    if (chunk->parts == NULL) {
+        chunk->parts = (pol_word_t*) malloc(MAX(CHUNK_BITS*e->part_words, 1)*sizeof(pol_word_t));
+        if (chunk->parts == NULL) exit(1);
+    }
+    pol_random_fill(chunk->parts, 8*chunk->n_bytes*e->part_words*sizeof(pol_word_t));
+}
+
+static void encrypt_chunk(void* stream, Chunk* chunk) {
+    Encoder* e = (Encoder*) stream;
+    // The ciphertexts of the previous use of the chunk are freed by the thread that allocated them
+    for (uint64_t j = 0; j < chunk->n_ciphers; j++) delete_polynom(chunk->ciphers[j]);
+    chunk->n_ciphers = 8*chunk->n_bytes;
+    for (uint64_t j = 0; j < chunk->n_ciphers; j++) chunk->bits[j] = (chunk->plain[j/8] >> (j%8)) & 1;
+    encrypt_bits_parts(chunk->bits, chunk->n_ciphers, e->pk, chunk->parts, chunk->ciphers);
+}
+
+static void write_frame(void* stream, Chunk* chunk) {
+    Encoder* e = (Encoder*) stream;
+    FrameHeader header = {chunk->n_bytes, 0};
+    for (uint64_t j = 0; j < chunk->n_ciphers; j++) {
+        header.payload_bytes += sizeof(uint64_t) + POL_WORDS(chunk->ciphers[j].degree + 1)*sizeof(pol_word_t);
+    }
+    reserve_frame(chunk, sizeof(header) + header.payload_bytes);
+    uint8_t* frame = chunk->frame;
+    memcpy(frame, &header, sizeof(header));
+    frame += sizeof(header);
+    for (uint64_t j = 0; j < chunk->n_ciphers; j++) {
+        uint64_t degree = chunk->ciphers[j].degree;
+        uint64_t n = POL_WORDS(degree + 1)*sizeof(pol_word_t);
+        memcpy(frame, &degree, sizeof(degree));
+        memcpy(frame + sizeof(degree), chunk->ciphers[j].coefficients, n);
+        frame += sizeof(degree) + n;
+    }
+    e->out.write(e->out.state, chunk->frame, sizeof(header) + header.payload_bytes);
+}
+
+uint64_t encrypt_stream(ByteSource in, PubKey pk, ByteSink out) {
+    StreamHeader header = {{0}, STREAM_VERSION, BYTE_ORDER_MARK, 0};
+    memcpy(header.magic, magic, sizeof(magic));
+    out.write(out.state, (const uint8_t*) &header, sizeof(header));
+
+    Encoder e = {in, pk, out, POL_WORDS(pk.size), false, 0};
+    Pipeline p = {.stages = {read_plain, encrypt_chunk, write_frame}, .stream = &e, .chunks = new_chunks()};
+    run_pipeline(&p);
+    for (uint32_t i = 0; i < STREAM_SLOTS; i++) {
+        for (uint64_t j = 0; j < p.chunks[i].n_ciphers; j++) delete_polynom(p.chunks[i].ciphers[j]);
+    }
+    delete_chunks(p.chunks);
+    return e.total;
+}
+
+
+typedef struct {
+    ByteSource in;
+    SecKey sk;
+    ByteSink out;
+    DecryptContext ctx;
+    bool has_ctx;
+    uint64_t total;
+} Decoder;
+
+static void read_frame(void* stream, Chunk* chunk) {
+    Decoder* d = (Decoder*) stream;
+    FrameHeader header;
+    read_exact(d->in, &header, sizeof(header));
+    if (header.n_bytes > STREAM_CHUNK_BYTES) exit(EXIT_BAD_STREAM);
+    // Each ciphertext takes at least its degree and one word
+    if (header.payload_bytes % sizeof(uint64_t) != 0 || header.payload_bytes < 8*header.n_bytes*2*sizeof(uint64_t)) exit(EXIT_BAD_STREAM);
+    reserve_frame(chunk, header.payload_bytes);
+    read_exact(d->in, chunk->frame, header.payload_bytes);
+    chunk->frame_length = header.payload_bytes;
+    chunk->n_bytes = header.n_bytes;
+    d->total += header.n_bytes;
+}
+
+// The ciphertexts are views on the payload, checked as the polynoms of storage.h
+static void parse_frame(Chunk* chunk) {
+    const uint8_t* frame = chunk->frame;
+    uint64_t left = chunk->frame_length;
+    chunk->n_ciphers = 8*chunk->n_bytes;
+    for (uint64_t j = 0; j < chunk->n_ciphers; j++) {
+        uint64_t degree;
+        if (left < sizeof(degree)) exit(EXIT_BAD_STREAM);
+        memcpy(&degree, frame, sizeof(degree));
+        frame += sizeof(degree);
+        left -= sizeof(degree);
+        if (degree > UINT32_MAX || POL_WORDS(degree + 1) > left / sizeof(pol_word_t)) exit(EXIT_BAD_STREAM);
+        uint64_t words = POL_WORDS(degree + 1);
+        Polynomial_t c = {(pol_word_t*)(uintptr_t) frame, (pol_degree_t) degree, 0};
+        pol_word_t top = c.coefficients[words-1];
+        uint8_t bit = degree % POL_WORD_BITS;
+        if (bit < POL_WORD_BITS-1 && (top >> (bit+1)) != 0) exit(EXIT_BAD_STREAM);
+        if (!((top >> bit) & 1) && (degree != 0 || top != 0)) exit(EXIT_BAD_STREAM);
+        chunk->ciphers[j] = c;
+        frame += words*sizeof(pol_word_t);
+        left -= words*sizeof(pol_word_t);
+    }
+    if (left != 0) exit(EXIT_BAD_STREAM);
+}
+
+static void decrypt_chunk(void* stream, Chunk* chunk) {
+    Decoder* d = (Decoder*) stream;
+    parse_frame(chunk);
+    // The ciphertexts of a stream have about the same degree, so one reciprocal serves them all
+    pol_degree_t max_degree = d->sk.degree;
+    for (uint64_t j = 0; j < chunk->n_ciphers; j++) max_degree = MAX(max_degree, chunk->ciphers[j].degree);
+    if (!d->has_ctx || max_degree > d->ctx.max_degree) {
+        if (d->has_ctx) decrypt_context_clear(d->ctx);
+        decrypt_context_init(d->sk, max_degree, &d->ctx);
+        d->has_ctx = true;
+    }
+    decrypt_bits(chunk->ciphers, chunk->n_ciphers, d->ctx, chunk->bits);
+    memset(chunk->plain, 0, chunk->n_bytes);
+    for (uint64_t j = 0; j < chunk->n_ciphers; j++) chunk->plain[j/8] |= (uint8_t)chunk->bits[j] << (j%8);
+}
+
+static void write_plain(void* stream, Chunk* chunk) {
+    Decoder* d = (Decoder*) stream;
+    if (chunk->n_bytes > 0) d->out.write(d->out.state, chunk->plain, chunk->n_bytes);
+}
+
+uint64_t decrypt_stream(ByteSource in, SecKey sk, ByteSink out) {
+    StreamHeader header;
+    read_exact(in, &header, sizeof(header));
+    if (memcmp(header.magic, magic, sizeof(magic)) != 0) exit(EXIT_BAD_STREAM);
+    if (header.version != STREAM_VERSION || header.byte_order != BYTE_ORDER_MARK) exit(EXIT_BAD_STREAM);
+
+    Decoder d = {.in = in, .sk = sk, .out = out, .has_ctx = false, .total = 0};
+    Pipeline p = {.stages = {read_frame, decrypt_chunk, write_plain}, .stream = &d, .chunks = new_chunks()};
+    run_pipeline(&p);
+    // The context was made on the decrypting thread, and is freed on this one
+    if (d.has_ctx) decrypt_context_clear(d.ctx);
+    delete_chunks(p.chunks);
+    return d.total;
+}
+
+
+static uint64_t fd_read(void* state, uint8_t* buffer, uint64_t n) {
+    int fd = (int)(intptr_t) state;
+    for (;;) {
+        ssize_t r = read(fd, buffer, n);
+        if (r >= 0) return (uint64_t) r;
+        if (errno != EINTR) exit(EXIT_BAD_STREAM);
+    }
+}
+
+static void fd_write(void* state, const uint8_t* buffer, uint64_t n) {
+    int fd = (int)(intptr_t) state;
+    while (n > 0) {
+        ssize_t r = write(fd, buffer, n);
+        if (r < 0) {
+            if (errno != EINTR) exit(EXIT_BAD_STREAM);
+            continue;
+        }
+        buffer += r;
+        n -= (uint64_t) r;
+    }
+}
+
+ByteSource fd_source(int fd) {
+    return (ByteSource){fd_read, (void*)(intptr_t) fd};
+}
+
+ByteSink fd_sink(int fd) {
+    return (ByteSink){fd_write, (void*)(intptr_t) fd};
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "homomorph.h"
+
+// Plain bytes per frame: each one becomes 8 ciphertexts
+#define STREAM_CHUNK_BYTES 1024
+// Chunks in flight between the stages of a stream, which bounds its memory
+#define STREAM_SLOTS 3
+
+#define STREAM_VERSION 1
+
+#define EXIT_BAD_STREAM 7
+
+
+/**
+ * @file stream.h
+ * @brief Encryption and decryption of byte streams.
+ *
+ * A stream is cut in chunks of STREAM_CHUNK_BYTES bytes, each one encrypted bit by bit into a frame of ciphertexts.
+ * The work runs as a pipeline of three stages on three threads, the calling one included, each stage handing its chunks to the next one:
+ * reading the bytes and drawing the random parts, the subset sums of the public key, and writing the frames.
+ * Decryption is the same pipeline, with reading the frames, decrypting, and writing the bytes.
+ * At most STREAM_SLOTS chunks are in flight, so the memory does not depend on the length of the stream.
+ *
+ * An encrypted stream is a header, then one frame per chunk, then an empty frame that marks its end.
+ * A frame holds its number of plain bytes, the length of its payload, then each ciphertext as its degree followed by its words, the least significant bit of the first byte first.
+ * As in the files of storage.h, the numbers are in the byte order of the machine that wrote them.
+ * Read and write errors, as well as malformed streams, exit with EXIT_BAD_STREAM.
+ *
+ * @see encrypt_stream
+ * @see decrypt_stream
+*/
+
+
+/**
+ * @brief Source of bytes
+ *
+ * read writes up to n bytes to buffer and returns how many it wrote, 0 meaning the end of the source.
+ *
+ * @param read Function reading from the source.
+ * @param state Argument given to read.
+ *
+ * @see fd_source
+*/
+typedef struct {
+    uint64_t (*read)(void* state, uint8_t* buffer, uint64_t n);
+    void* state;
+} ByteSource;
+
+/**
+ * @brief Destination of bytes
+ *
+ * write takes all the n bytes of buffer.
+ *
+ * @param write Function writing to the destination.
+ * @param state Argument given to write.
+ *
+ * @see fd_sink
+*/
+typedef struct {
+    void (*write)(void* state, const uint8_t* buffer, uint64_t n);
+    void* state;
+} ByteSink;
+
+/**
+ * @brief Reads from a file descriptor
+ *
+ * @param[in] fd The file descriptor, which stays open
+ * @return The source
+*/
+ByteSource fd_source(int fd);
+
+/**
+ * @brief Writes to a file descriptor
+ *
+ * @param[in] fd The file descriptor, which stays open
+ * @return The destination
+*/
+ByteSink fd_sink(int fd);
+
+/**
+ * @brief Encrypts a stream of bytes
+ *
+ * The random parts are drawn on the calling thread, so seeding it with pol_random_seed gives the same stream for the same input.
+ * The read callback runs on the calling thread, and the write one on another thread.
+ *
+ * @param[in] in The plain bytes
+ * @param[in] pk The public key
+ * @param[in] out The encrypted stream
+ * @return The number of plain bytes encrypted
+*/
+uint64_t encrypt_stream(ByteSource in, PubKey pk, ByteSink out);
+
+/**
+ * @brief Decrypts a stream of bytes
+ *
+ * The read callback runs on the calling thread, and the write one on another thread.
+ *
+ * @param[in] in The encrypted stream
+ * @param[in] sk The secret key
+ * @param[in] out The plain bytes
+ * @return The number of plain bytes decrypted
+*/
+uint64_t decrypt_stream(ByteSource in, SecKey sk, ByteSink out);
@@ -0,0 +1,161 @@
+#include "clmul.h"
+
+#include "words.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CLMUL_X86
+#endif
+
+
+void clmul_word(pol_word_t a, pol_word_t b, pol_word_t* lo, pol_word_t* hi) {
+    // Window of 4 bits of a: table[n] = n*b, truncated to 64 bits
+    pol_word_t table[16];
+    table[0] = 0;
+    table[1] = b;
+    for (uint8_t n = 2; n < 16; n += 2) {
+        table[n] = table[n/2] << 1;
+        table[n+1] = table[n] ^ b;
+    }
+
+    pol_word_t l = 0, h = 0;
+    for (int8_t shift = POL_WORD_BITS-4; shift >= 0; shift -= 4) {
+        h = (h << 4) | (l >> (POL_WORD_BITS-4));
+        l = (l << 4) ^ table[(a >> shift) & 0xF];
+    }
+
+    // Repair the 3 top bits of b that the table lost
+    static const pol_word_t masks[3] = {0xEEEEEEEEEEEEEEEEULL, 0xCCCCCCCCCCCCCCCCULL, 0x8888888888888888ULL};
+    for (uint8_t i = 1; i < 4; i++) {
+        if ((b >> (POL_WORD_BITS-i)) & 1) h ^= (a & masks[i-1]) >> i;
+    }
+
+    *lo = l;
+    *hi = h;
+}
+
+
+static void clmul_words_portable(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r) {
+    pol_word_t lo, hi;
+    for (uint64_t i = 0; i < na; i++) {
+        if (!a[i]) continue;
+        for (uint64_t j = 0; j < nb; j++) {
+            clmul_word(a[i], b[j], &lo, &hi);
+            r[i+j] ^= lo;
+            r[i+j+1] ^= hi;
+        }
+    }
+}
+
+#ifdef CLMUL_X86
+__attribute__((target("sse2,pclmul")))
+static void clmul_words_pclmul(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r) {
+    for (uint64_t i = 0; i < na; i++) {
+        if (!a[i]) continue;
+        __m128i av = _mm_set1_epi64x((long long)a[i]);
+        __m128i carry = _mm_setzero_si128();
+        uint64_t j = 0;
+        for (; j+2 <= nb; j += 2) {
+            __m128i bv = _mm_loadu_si128((const __m128i*)(b+j));
+            // a*b[j] lands on words j, j+1 and a*b[j+1] on words j+1, j+2
+            __m128i even = _mm_clmulepi64_si128(av, bv, 0x00);
+            __m128i odd = _mm_clmulepi64_si128(av, bv, 0x10);
+            __m128i acc = _mm_xor_si128(even, _mm_slli_si128(odd, 8));
+            acc = _mm_xor_si128(acc, carry);
+            carry = _mm_srli_si128(odd, 8);
+            __m128i* dst = (__m128i*)(r+i+j);
+            _mm_storeu_si128(dst, _mm_xor_si128(_mm_loadu_si128(dst), acc));
+        }
+        r[i+j] ^= (pol_word_t)_mm_cvtsi128_si64(carry);
+        if (j < nb) {
+            __m128i p = _mm_clmulepi64_si128(av, _mm_set_epi64x(0, (long long)b[j]), 0x00);
+            r[i+j] ^= (pol_word_t)_mm_cvtsi128_si64(p);
+            r[i+j+1] ^= (pol_word_t)_mm_cvtsi128_si64(_mm_srli_si128(p, 8));
+        }
+    }
+}
+
+__attribute__((target("avx2,vpclmulqdq,pclmul")))
+static void clmul_words_vpclmul256(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r) {
+    for (uint64_t i = 0; i < na; i++) {
+        if (!a[i]) continue;
+        __m256i av = _mm256_set1_epi64x((long long)a[i]);
+        __m256i odd_prev = _mm256_setzero_si256();
+        uint64_t j = 0;
+        for (; j+4 <= nb; j += 4) {
+            __m256i bv = _mm256_loadu_si256((const __m256i*)(b+j));
+            __m256i even = _mm256_clmulepi64_epi128(av, bv, 0x00);
+            __m256i odd = _mm256_clmulepi64_epi128(av, bv, 0x10);
+            // Odd products are one word higher: words 0, 0, 1, 2 of this block, the first one replaced by the top word of the previous block
+            __m256i shifted = _mm256_permute4x64_epi64(odd, 0x90);
+            shifted = _mm256_blend_epi32(shifted, _mm256_permute4x64_epi64(odd_prev, 0xFF), 0x03);
+            __m256i acc = _mm256_xor_si256(even, shifted);
+            odd_prev = odd;
+            __m256i* dst = (__m256i*)(r+i+j);
+            _mm256_storeu_si256(dst, _mm256_xor_si256(_mm256_loadu_si256(dst), acc));
+        }
+        r[i+j] ^= (pol_word_t)_mm256_extract_epi64(odd_prev, 3);
+        for (; j < nb; j++) {
+            __m128i p = _mm_clmulepi64_si128(_mm256_castsi256_si128(av), _mm_set_epi64x(0, (long long)b[j]), 0x00);
+            r[i+j] ^= (pol_word_t)_mm_cvtsi128_si64(p);
+            r[i+j+1] ^= (pol_word_t)_mm_cvtsi128_si64(_mm_srli_si128(p, 8));
+        }
+    }
+}
+
+__attribute__((target("avx512f,vpclmulqdq,pclmul")))
+static void clmul_words_vpclmul(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r) {
+    const __m512i shift_up = _mm512_set_epi64(6, 5, 4, 3, 2, 1, 0, 15);
+    for (uint64_t i = 0; i < na; i++) {
+        if (!a[i]) continue;
+        __m512i av = _mm512_set1_epi64((long long)a[i]);
+        __m512i odd_prev = _mm512_setzero_si512();
+        uint64_t j = 0;
+        for (; j+8 <= nb; j += 8) {
+            __m512i bv = _mm512_loadu_si512((const void*)(b+j));
+            __m512i even = _mm512_clmulepi64_epi128(av, bv, 0x00);
+            __m512i odd = _mm512_clmulepi64_epi128(av, bv, 0x10);
+            // Odd products are one word higher: shift them up, taking the top word of the previous block
+            __m512i acc = _mm512_xor_si512(even, _mm512_permutex2var_epi64(odd, shift_up, odd_prev));
+            odd_prev = odd;
+            pol_word_t* dst = r+i+j;
+            _mm512_storeu_si512((void*)dst, _mm512_xor_si512(_mm512_loadu_si512((const void*)dst), acc));
+        }
+        __m128i top = _mm512_extracti32x4_epi32(odd_prev, 3);
+        r[i+j] ^= (pol_word_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(top, top));
+        for (; j < nb; j++) {
+            __m128i p = _mm_clmulepi64_si128(_mm512_castsi512_si128(av), _mm_set_epi64x(0, (long long)b[j]), 0x00);
+            r[i+j] ^= (pol_word_t)_mm_cvtsi128_si64(p);
+            r[i+j+1] ^= (pol_word_t)_mm_cvtsi128_si64(_mm_srli_si128(p, 8));
+        }
+    }
+}
+#endif
+
+
+typedef void (*clmul_words_kernel)(const pol_word_t*, uint64_t, const pol_word_t*, uint64_t, pol_word_t*);
+
+// The widest kernel of the level whose instructions the CPU has
+static clmul_words_kernel select_kernel(PolIsa isa) {
+#ifdef CLMUL_X86
+    bool vpclmul = __builtin_cpu_supports("vpclmulqdq");
+    if (isa >= POL_ISA_AVX512 && vpclmul) return clmul_words_vpclmul;
+    if (isa >= POL_ISA_AVX2 && vpclmul) return clmul_words_vpclmul256;
+    if (isa >= POL_ISA_SSE2 && __builtin_cpu_supports("pclmul")) return clmul_words_pclmul;
+#else
+    (void)isa;
+#endif
+    return clmul_words_portable;
+}
+
+void clmul_words(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r) {
+    // Cache of the kernel of each level, accessed atomically since any thread may fill it
+    static clmul_words_kernel kernels[POL_ISA_AUTO] = {NULL};
+    PolIsa isa = get_pol_isa();
+    clmul_words_kernel kernel = __atomic_load_n(&kernels[isa], __ATOMIC_RELAXED);
+    if (kernel == NULL) {
+        kernel = select_kernel(isa);
+        __atomic_store_n(&kernels[isa], kernel, __ATOMIC_RELAXED);
+    }
+    kernel(a, na, b, nb, r);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "polynom.h"
+
+
+/**
+ * @file clmul.h
+ * @brief Carry-less multiplication kernels.
+ *
+ * This file contains the word-level kernels used to multiply polynoms of Z/2Z[X].
+ * Multiplying two words without carries is exactly multiplying two polynoms of degree less than 64 in Z/2Z[X].
+ * The kernels use the PCLMULQDQ or VPCLMULQDQ instructions when the CPU supports them, and a portable implementation otherwise.
+ * The kernel is selected at runtime, the first time one is needed, among the ones of the instruction set of set_pol_isa.
+ *
+ * @see multiply_polynoms
+ * @see PolIsa
+*/
+
+
+/**
+ * @brief Carry-less product of two words
+ *
+ * This function computes the 128-bit carry-less product of two words.
+ *
+ * @param[in] a First word.
+ * @param[in] b Second word.
+ * @param[out] lo Pointer to the lower word of the product.
+ * @param[out] hi Pointer to the higher word of the product.
+*/
+void clmul_word(pol_word_t a, pol_word_t b, pol_word_t* lo, pol_word_t* hi);
+
+/**
+ * @brief Accumulate the product of two word arrays
+ *
+ * This function computes r ^= a*b, where a, b and r are packed polynoms of na, nb and na+nb words.
+ * Words of a that are zero are skipped, so sparse operands such as monoms are cheap.
+ * r must not overlap with a or b.
+ *
+ * @param[in] a Words of the first polynom.
+ * @param[in] na Number of words of a.
+ * @param[in] b Words of the second polynom.
+ * @param[in] nb Number of words of b.
+ * @param[in,out] r Words of the result, must hold na+nb words.
+*/
+void clmul_words(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r);
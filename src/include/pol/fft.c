@@ -0,0 +1,218 @@
+#include "fft.h"
+
+#include "clmul.h"
+#include "pool.h"
+#include "words.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define FFT_X86
+#endif
+
+
+// Reduction modulo t^64+t^4+t^3+t+1: t^64 = t^4+t^3+t+1
+static inline pol_word_t gf64_reduce(pol_word_t lo, pol_word_t hi) {
+    pol_word_t overflow = (hi >> 60) ^ (hi >> 61) ^ (hi >> 63);
+    hi ^= overflow;
+    return lo ^ hi ^ (hi << 1) ^ (hi << 3) ^ (hi << 4);
+}
+
+pol_word_t gf64_mul(pol_word_t a, pol_word_t b) {
+    pol_word_t lo, hi;
+    clmul_word(a, b, &lo, &hi);
+    return gf64_reduce(lo, hi);
+}
+
+#ifdef FFT_X86
+__attribute__((target("sse2,pclmul")))
+static inline pol_word_t gf64_mul_pclmul(pol_word_t a, pol_word_t b) {
+    __m128i p = _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)a), _mm_cvtsi64_si128((long long)b), 0x00);
+    return gf64_reduce((pol_word_t)_mm_cvtsi128_si64(p), (pol_word_t)_mm_cvtsi128_si64(_mm_srli_si128(p, 8)));
+}
+#endif
+
+
+// Solves x^2 + x = c, c must have a null trace
+static pol_word_t solve_artin_schreier(pol_word_t c) {
+    // Echelon form of the linear map x -> x^2 + x, pivots indexed by their highest bit
+    pol_word_t pivots[POL_WORD_BITS] = {0};
+    pol_word_t preimages[POL_WORD_BITS] = {0};
+    for (uint8_t k = 0; k < POL_WORD_BITS; k++) {
+        pol_word_t x = (pol_word_t)1 << k;
+        pol_word_t v = gf64_mul(x, x) ^ x;
+        while (v) {
+            uint8_t top = POL_WORD_BITS-1 - __builtin_clzll(v);
+            if (!pivots[top]) {
+                pivots[top] = v;
+                preimages[top] = x;
+                break;
+            }
+            v ^= pivots[top];
+            x ^= preimages[top];
+        }
+    }
+
+    pol_word_t x = 0;
+    while (c) {
+        uint8_t top = POL_WORD_BITS-1 - __builtin_clzll(c);
+        if (!pivots[top]) exit(1);
+        c ^= pivots[top];
+        x ^= preimages[top];
+    }
+    return x;
+}
+
+// Cantor basis: beta[0] = 1 and beta[i]^2 + beta[i] = beta[i-1]
+// With this basis, the subspace polynomials s_i satisfy s_i(beta[k]) = beta[k-i]
+static void cantor_basis(pol_word_t* beta, uint8_t n) {
+    beta[0] = 1;
+    for (uint8_t i = 1; i < n; i++) beta[i] = solve_artin_schreier(beta[i-1]);
+}
+
+
+// In the Cantor basis, s_i(X) is the sum of the X^(2^j) for j such that j & i = j
+// Monomial to novel basis: divide each block of size 2^(i+1) by s_i, from the top
+// s_0 = X, so the last layer has nothing to do
+static void to_novel_basis(pol_word_t* f, uint8_t m) {
+    uint64_t n = (uint64_t)1 << m;
+    for (uint8_t i = m-1; i > 0; i--) {
+        uint64_t half = (uint64_t)1 << i;
+        for (uint64_t s = 0; s < n; s += 2*half) {
+            for (uint64_t d = 2*half-1; d >= half; d--) {
+                pol_word_t c = f[s+d];
+                if (!c) continue;
+                for (uint8_t j = (i-1) & i;; j = (j-1) & i) {
+                    f[s+d-half + ((uint64_t)1 << j)] ^= c;
+                    if (j == 0) break;
+                }
+            }
+        }
+    }
+}
+
+// Novel to monomial basis: the same additions, in reverse order
+static void from_novel_basis(pol_word_t* f, uint8_t m) {
+    uint64_t n = (uint64_t)1 << m;
+    for (uint8_t i = 1; i < m; i++) {
+        uint64_t half = (uint64_t)1 << i;
+        for (uint64_t s = 0; s < n; s += 2*half) {
+            for (uint64_t d = half; d < 2*half; d++) {
+                pol_word_t c = f[s+d];
+                if (!c) continue;
+                for (uint8_t j = (i-1) & i;; j = (j-1) & i) {
+                    f[s+d-half + ((uint64_t)1 << j)] ^= c;
+                    if (j == 0) break;
+                }
+            }
+        }
+    }
+}
+
+
+// Block b of every layer is shifted by s_i(omega[b * 2^(i+1)]) = omega[2b], the subset sum of beta[k+1] over the bits k of b
+// Forward:  f0 += lambda*f1, f1 += f0
+// Inverse:  f1 += f0, f0 += lambda*f1
+static void fft_layers_portable(pol_word_t* f, uint8_t m, const pol_word_t* lambdas, bool inverse) {
+    uint64_t n = (uint64_t)1 << m;
+    for (uint8_t l = 0; l < m; l++) {
+        uint8_t i = inverse ? l : m-1-l;
+        uint64_t half = (uint64_t)1 << i;
+        for (uint64_t b = 0; b < (n >> (i+1)); b++) {
+            pol_word_t lambda = lambdas[b];
+            pol_word_t* f0 = f + (b << (i+1));
+            pol_word_t* f1 = f0 + half;
+            for (uint64_t t = 0; t < half; t++) {
+                if (inverse) f1[t] ^= f0[t];
+                if (lambda) f0[t] ^= gf64_mul(lambda, f1[t]);
+                if (!inverse) f1[t] ^= f0[t];
+            }
+        }
+    }
+}
+
+static void pointwise_portable(pol_word_t* fa, const pol_word_t* fb, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) fa[i] = gf64_mul(fa[i], fb[i]);
+}
+
+#ifdef FFT_X86
+__attribute__((target("sse2,pclmul")))
+static void fft_layers_pclmul(pol_word_t* f, uint8_t m, const pol_word_t* lambdas, bool inverse) {
+    uint64_t n = (uint64_t)1 << m;
+    for (uint8_t l = 0; l < m; l++) {
+        uint8_t i = inverse ? l : m-1-l;
+        uint64_t half = (uint64_t)1 << i;
+        for (uint64_t b = 0; b < (n >> (i+1)); b++) {
+            pol_word_t lambda = lambdas[b];
+            pol_word_t* f0 = f + (b << (i+1));
+            pol_word_t* f1 = f0 + half;
+            for (uint64_t t = 0; t < half; t++) {
+                if (inverse) f1[t] ^= f0[t];
+                if (lambda) f0[t] ^= gf64_mul_pclmul(lambda, f1[t]);
+                if (!inverse) f1[t] ^= f0[t];
+            }
+        }
+    }
+}
+
+__attribute__((target("sse2,pclmul")))
+static void pointwise_pclmul(pol_word_t* fa, const pol_word_t* fb, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) fa[i] = gf64_mul_pclmul(fa[i], fb[i]);
+}
+#endif
+
+
+void fft_mul_words(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r) {
+    if (na == 0 || nb == 0) return;
+    // Product has 2(na+nb)-1 chunks of 32 bits
+    uint64_t chunks = 2*(na+nb) - 1;
+    uint8_t m = 1;
+    while (((uint64_t)1 << m) < chunks) m++;
+    uint64_t n = (uint64_t)1 << m;
+
+    uint64_t capacity;
+    pol_word_t* fa = pol_allocate(2*n + n/2, &capacity);
+    pol_word_t* fb = fa + n;
+    pol_word_t* lambdas = fb + n;
+
+    pol_word_t beta[POL_WORD_BITS];
+    cantor_basis(beta, m+1);
+    for (uint64_t k = 1; k < n/2; k++) {
+        lambdas[k] = lambdas[k & (k-1)] ^ beta[__builtin_ctzll(k) + 1];
+    }
+
+    for (uint64_t i = 0; i < na; i++) {
+        fa[2*i] = a[i] & 0xFFFFFFFF;
+        fa[2*i+1] = a[i] >> 32;
+    }
+    for (uint64_t i = 0; i < nb; i++) {
+        fb[2*i] = b[i] & 0xFFFFFFFF;
+        fb[2*i+1] = b[i] >> 32;
+    }
+
+    to_novel_basis(fa, m);
+    to_novel_basis(fb, m);
+    void (*fft_layers)(pol_word_t*, uint8_t, const pol_word_t*, bool) = fft_layers_portable;
+    void (*pointwise)(pol_word_t*, const pol_word_t*, uint64_t) = pointwise_portable;
+#ifdef FFT_X86
+    if (get_pol_isa() >= POL_ISA_SSE2 && __builtin_cpu_supports("pclmul")) {
+        fft_layers = fft_layers_pclmul;
+        pointwise = pointwise_pclmul;
+    }
+#endif
+    fft_layers(fa, m, lambdas, false);
+    fft_layers(fb, m, lambdas, false);
+    pointwise(fa, fb, n);
+    fft_layers(fa, m, lambdas, true);
+    from_novel_basis(fa, m);
+
+    // Chunk k of the product has 63 bits and starts at bit 32k
+    for (uint64_t k = 0; k < chunks; k++) {
+        if (k % 2 == 0) r[k/2] ^= fa[k];
+        else {
+            r[k/2] ^= fa[k] << 32;
+            r[k/2+1] ^= fa[k] >> 32;
+        }
+    }
+
+    pol_release(fa, capacity);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "polynom.h"
+
+
+/**
+ * @file fft.h
+ * @brief Additive FFT multiplication for very large polynoms.
+ *
+ * Polynoms of Z/2Z[X] are cut into 32-bit chunks, seen as polynoms over GF(2^64) = Z/2Z[t]/(t^64+t^4+t^3+t+1).
+ * The product of two chunks has less than 64 bits, so the product over GF(2^64) gives back the product in Z/2Z[X].
+ * Polynoms over GF(2^64) are multiplied with the additive FFT of Lin, Chung and Han, which evaluates them on a subspace spanned by a Cantor basis.
+ * In the Cantor basis, the change between the monomial basis and the novel polynomial basis of the FFT only needs additions.
+ * Multiplying two polynoms of n coefficients costs O(n log(n)) multiplications in GF(2^64).
+ *
+ * @see mul_words
+*/
+
+
+/**
+ * @brief Multiply two elements of GF(2^64)
+ *
+ * @param[in] a First element.
+ * @param[in] b Second element.
+ * @return Product of a and b modulo t^64+t^4+t^3+t+1.
+*/
+pol_word_t gf64_mul(pol_word_t a, pol_word_t b);
+
+/**
+ * @brief Accumulate the product of two word arrays with the additive FFT
+ *
+ * This function computes r ^= a*b, where a, b and r are packed polynoms of na, nb and na+nb words.
+ * r must not overlap with a or b.
+ *
+ * @param[in] a Words of the first polynom.
+ * @param[in] na Number of words of a.
+ * @param[in] b Words of the second polynom.
+ * @param[in] nb Number of words of b.
+ * @param[in,out] r Words of the result, must hold na+nb words.
+*/
+void fft_mul_words(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r);
@@ -0,0 +1,213 @@
+#include "mul.h"
+
+#include <string.h>
+
+#include "clmul.h"
+#include "fft.h"
+#include "pool.h"
+#include "words.h"
+
+
+static MulThresholds thresholds = {KARATSUBA_THRESHOLD, TOOM3_THRESHOLD, FFT_THRESHOLD};
+
+void set_mul_thresholds(MulThresholds t) {
+    thresholds = t;
+}
+
+MulThresholds get_mul_thresholds(void) {
+    return thresholds;
+}
+
+
+// dst ^= src * X^bits, with 0 < bits < POL_WORD_BITS, dst holds n+1 words
+static void xor_shifted_words(pol_word_t* dst, const pol_word_t* src, uint64_t n, uint8_t bits) {
+    dst[n] ^= shift_xor_words(dst, src, n, bits);
+}
+
+// p /= X, p must be divisible by X
+static void divide_by_x(pol_word_t* p, uint64_t n) {
+    for (uint64_t i = 0; i+1 < n; i++) p[i] = (p[i] >> 1) | (p[i+1] << (POL_WORD_BITS-1));
+    p[n-1] >>= 1;
+}
+
+// p /= X+1, p must be divisible by X+1
+// The quotient is the prefix sum of the coefficients of p
+static void divide_by_x_plus_1(pol_word_t* p, uint64_t n) {
+    pol_word_t carry = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        pol_word_t w = p[i];
+        for (uint8_t s = 1; s < POL_WORD_BITS; s <<= 1) w ^= w << s;
+        w ^= carry;
+        carry = (pol_word_t)0 - (w >> (POL_WORD_BITS-1));
+        p[i] = w;
+    }
+}
+
+
+// Requires na >= nb > (na+1)/2
+static void mul_karatsuba(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r) {
+    uint64_t k = (na+1)/2;
+    uint64_t la1 = na-k, lb1 = nb-k;
+    uint64_t capacity;
+    pol_word_t* buffer = pol_allocate(2*k + 2*k + 2*k + la1+lb1, &capacity);
+    pol_word_t* sa = buffer;
+    pol_word_t* sb = sa + k;
+    pol_word_t* p0 = sb + k;
+    pol_word_t* p1 = p0 + 2*k;
+    pol_word_t* p2 = p1 + 2*k;
+
+    // (a0+a1)(b0+b1) = a0b0 + a1b1 + (a0b1+a1b0)
+    memcpy(sa, a, k*sizeof(pol_word_t));
+    xor_words(sa, a+k, la1);
+    memcpy(sb, b, k*sizeof(pol_word_t));
+    xor_words(sb, b+k, lb1);
+    mul_words(a, k, b, k, p0);
+    mul_words(sa, k, sb, k, p1);
+    mul_words(a+k, la1, b+k, lb1, p2);
+    xor_words(p1, p0, 2*k);
+    xor_words(p1, p2, la1+lb1);
+
+    xor_words(r, p0, 2*k);
+    xor_words(r+k, p1, 2*k);
+    xor_words(r+2*k, p2, la1+lb1);
+
+    pol_release(buffer, capacity);
+}
+
+// Requires na >= nb > 2*((na+2)/3)
+static void mul_toom3(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r) {
+    uint64_t k = (na+2)/3;
+    uint64_t la2 = na-2*k, lb2 = nb-2*k;
+    uint64_t l = 2*k+2;
+    uint64_t capacity;
+    pol_word_t* buffer = pol_allocate(6*(k+1) + 5*l, &capacity);
+    pol_word_t* a1 = buffer;
+    pol_word_t* b1 = a1 + k+1;
+    pol_word_t* ax = b1 + k+1;
+    pol_word_t* bx = ax + k+1;
+    pol_word_t* ax1 = bx + k+1;
+    pol_word_t* bx1 = ax1 + k+1;
+    pol_word_t* w0 = bx1 + k+1;
+    pol_word_t* w1 = w0 + l;
+    pol_word_t* wx = w1 + l;
+    pol_word_t* wx1 = wx + l;
+    pol_word_t* winf = wx1 + l;
+
+    // Evaluate at 1, X and X+1
+    memcpy(a1, a, k*sizeof(pol_word_t));
+    xor_words(a1, a+k, k);
+    xor_words(a1, a+2*k, la2);
+    memcpy(ax, a, k*sizeof(pol_word_t));
+    xor_shifted_words(ax, a+k, k, 1);
+    xor_shifted_words(ax, a+2*k, la2, 2);
+    memcpy(ax1, ax, (k+1)*sizeof(pol_word_t));
+    xor_words(ax1, a1, k);
+    xor_words(ax1, a, k);
+
+    memcpy(b1, b, k*sizeof(pol_word_t));
+    xor_words(b1, b+k, k);
+    xor_words(b1, b+2*k, lb2);
+    memcpy(bx, b, k*sizeof(pol_word_t));
+    xor_shifted_words(bx, b+k, k, 1);
+    xor_shifted_words(bx, b+2*k, lb2, 2);
+    memcpy(bx1, bx, (k+1)*sizeof(pol_word_t));
+    xor_words(bx1, b1, k);
+    xor_words(bx1, b, k);
+
+    mul_words(a, k, b, k, w0);
+    mul_words(a1, k, b1, k, w1);
+    mul_words(ax, k+1, bx, k+1, wx);
+    mul_words(ax1, k+1, bx1, k+1, wx1);
+    mul_words(a+2*k, la2, b+2*k, lb2, winf);
+
+    // Interpolate c0 + c1Y + c2Y^2 + c3Y^3 + c4Y^4, where c0 = w0 and c4 = winf
+    // w1 = c1+c2+c3
+    xor_words(w1, w0, l);
+    xor_words(w1, winf, la2+lb2);
+    // wx = c1 + c2X + c3X^2
+    xor_words(wx, w0, l);
+    xor_shifted_words(wx, winf, la2+lb2, 4);
+    divide_by_x(wx, l);
+    // wx1 = c1 + c2(X+1) + c3(X^2+1)
+    xor_words(wx1, w0, l);
+    xor_words(wx1, winf, la2+lb2);
+    xor_shifted_words(wx1, winf, la2+lb2, 4);
+    divide_by_x_plus_1(wx1, l);
+    // wx1 = c2+c3, w1 = c1
+    xor_words(wx1, wx, l);
+    xor_words(w1, wx1, l);
+    // wx = c2 + c3X, then c3
+    xor_words(wx, w1, l);
+    divide_by_x(wx, l);
+    xor_words(wx, wx1, l);
+    divide_by_x_plus_1(wx, l);
+    // wx1 = c2
+    xor_words(wx1, wx, l);
+
+    // Words beyond na+nb are null
+    uint64_t n = na+nb;
+    xor_words(r, w0, 2*k);
+    xor_words(r+k, w1, MIN(l, n-k));
+    xor_words(r+2*k, wx1, MIN(l, n-2*k));
+    xor_words(r+3*k, wx, MIN(l, n-3*k));
+    xor_words(r+4*k, winf, la2+lb2);
+
+    pol_release(buffer, capacity);
+}
+
+
+void mul_words(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r) {
+    if (na == 0 || nb == 0) return;
+    if (MIN(na, nb) < MIN(thresholds.karatsuba, thresholds.fft)) {
+        // The kernels vectorize over the words of their second operand, so it must be the longer one
+        if (na > nb) clmul_words(b, nb, a, na, r);
+        else clmul_words(a, na, b, nb, r);
+        return;
+    }
+    if (na < nb) {
+        const pol_word_t* tmp = a;
+        a = b;
+        b = tmp;
+        uint64_t ntmp = na;
+        na = nb;
+        nb = ntmp;
+    }
+
+    if (nb >= thresholds.fft) fft_mul_words(a, na, b, nb, r);
+    else if (nb >= thresholds.toom3 && nb > 2*((na+2)/3)) mul_toom3(a, na, b, nb, r);
+    else if (nb > (na+1)/2) mul_karatsuba(a, na, b, nb, r);
+    else {
+        // Unbalanced operands: multiply b by slices of a of its own size
+        for (uint64_t offset = 0; offset < na; offset += nb) {
+            mul_words(a+offset, MIN(nb, na-offset), b, nb, r+offset);
+        }
+    }
+}
+
+uint64_t mul_words_cost(uint64_t na, uint64_t nb) {
+    if (na == 0 || nb == 0) return 0;
+    if (MIN(na, nb) < MIN(thresholds.karatsuba, thresholds.fft)) return na*nb;
+    if (na < nb) {
+        uint64_t ntmp = na;
+        na = nb;
+        nb = ntmp;
+    }
+
+    if (nb >= thresholds.fft) {
+        // Three transforms of m layers of n/2 butterflies, and n pointwise products
+        uint64_t chunks = 2*(na+nb) - 1;
+        uint8_t m = 1;
+        while (((uint64_t)1 << m) < chunks) m++;
+        uint64_t n = (uint64_t)1 << m;
+        return 3*(3*(uint64_t)m*n/2 + n);
+    }
+    if (nb >= thresholds.toom3 && nb > 2*((na+2)/3)) {
+        uint64_t k = (na+2)/3;
+        return 4*mul_words_cost(k+1, k+1) + mul_words_cost(na-2*k, nb-2*k);
+    }
+    if (nb > (na+1)/2) {
+        uint64_t k = (na+1)/2;
+        return 2*mul_words_cost(k, k) + mul_words_cost(na-k, nb-k);
+    }
+    return (na/nb)*mul_words_cost(nb, nb) + mul_words_cost(na%nb, nb);
+}
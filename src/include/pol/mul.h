@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "polynom.h"
+#include "mul_params.h"
+
+
+/**
+ * @file mul.h
+ * @brief Multiplication algorithms for packed polynoms.
+ *
+ * This file contains the subquadratic multiplication algorithms of Z/2Z[X] on packed word arrays.
+ * Very large operands are multiplied with the additive FFT.
+ * Smaller ones are split recursively with Karatsuba or Toom-3 (evaluated at 0, 1, X, X+1 and infinity),
+ * down to the carry-less multiplication kernels once they are shorter than the thresholds.
+ *
+ * @see mul_params.h
+ * @see clmul_words
+ * @see fft_mul_words
+*/
+
+
+/**
+ * @brief MulThresholds structure
+ *
+ * This structure holds the number of words of the shorter operand from which each algorithm is used.
+ *
+ * @param karatsuba Threshold of Karatsuba multiplication.
+ * @param toom3 Threshold of Toom-3 multiplication.
+ * @param fft Threshold of the additive FFT multiplication.
+*/
+typedef struct {
+    uint64_t karatsuba;
+    uint64_t toom3;
+    uint64_t fft;
+} MulThresholds;
+
+/**
+ * @brief Set the multiplication thresholds
+ *
+ * This function overrides the thresholds of mul_params.h for the whole process.
+ * It is meant for tuning and must not be called while a multiplication is running.
+ *
+ * @param[in] thresholds New thresholds.
+ *
+ * @see MulThresholds
+*/
+void set_mul_thresholds(MulThresholds thresholds);
+
+/**
+ * @brief Get the multiplication thresholds
+ *
+ * @return Current thresholds.
+ *
+ * @see MulThresholds
+*/
+MulThresholds get_mul_thresholds(void);
+
+/**
+ * @brief Accumulate the product of two word arrays
+ *
+ * This function computes r ^= a*b, where a, b and r are packed polynoms of na, nb and na+nb words.
+ * The algorithm is chosen from the size of the operands.
+ * r must not overlap with a or b.
+ *
+ * @param[in] a Words of the first polynom.
+ * @param[in] na Number of words of a.
+ * @param[in] b Words of the second polynom.
+ * @param[in] nb Number of words of b.
+ * @param[in,out] r Words of the result, must hold na+nb words.
+ *
+ * @see MulThresholds
+*/
+void mul_words(const pol_word_t* a, uint64_t na, const pol_word_t* b, uint64_t nb, pol_word_t* r);
+
+/**
+ * @brief Estimate the cost of a multiplication
+ *
+ * This function follows the choices of mul_words for operands of na and nb words, and counts the word products of the kernels at the bottom of the recursion.
+ * An FFT counts three word products per multiplication in GF(2^64), its butterflies and pointwise products included.
+ * The additions of the recursive algorithms are neglected, so the estimate is a lower bound that stays within a small factor of the real work.
+ *
+ * @param[in] na Number of words of the first operand.
+ * @param[in] nb Number of words of the second operand.
+ * @return Estimated number of 64x64 carry-less products.
+ *
+ * @see mul_words
+*/
+uint64_t mul_words_cost(uint64_t na, uint64_t nb);
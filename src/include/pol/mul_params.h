@@ -0,0 +1,23 @@
+#pragma once
+
+/**
+ * @file mul_params.h
+ * @brief Thresholds of the multiplication algorithms.
+ *
+ * Thresholds are numbers of words of the shorter operand from which an algorithm is used.
+ * This file can be regenerated for a given machine with tests/tune_multiply.c.
+ *
+ * @see mul_words
+*/
+
+#ifndef KARATSUBA_THRESHOLD
+#define KARATSUBA_THRESHOLD 128
+#endif
+
+#ifndef TOOM3_THRESHOLD
+#define TOOM3_THRESHOLD 216
+#endif
+
+#ifndef FFT_THRESHOLD
+#define FFT_THRESHOLD 59049
+#endif
@@ -1,34 +1,42 @@
 #include "polynom.h"
 
+#include <string.h>
+
+#include "clmul.h"
+#include "mul.h"
+#include "pool.h"
+#include "random.h"
+#include "sparse.h"
+#include "words.h"
+
 
 static pol_degree_t degree_of_polynom(Polynomial_t p) {
-    for (pol_degree_t i = p.degree; i > 0; i--) {
-        if (p.coefficients[i]) return i;
-    }
-    return 0;
+    uint64_t w = used_words(p.coefficients, POL_WORDS(p.degree + 1));
+    if (w == 0) return 0;
+    return (pol_degree_t)((w-1)*POL_WORD_BITS + POL_WORD_BITS-1 - __builtin_clzll(p.coefficients[w-1]));
 }
 
+// Zeroed words from the allocator, size receives the number of coefficients they can hold
+static pol_word_t* allocate_words(uint64_t n_words, pol_degree_t* size) {
+    uint64_t capacity;
+    pol_word_t* words = pol_allocate(n_words, &capacity);
+    *size = capacity * POL_WORD_BITS;
+    return words;
+}
 
 Polynomial_t monom(pol_degree_t degree) {
     Polynomial_t p = {0};
     if (degree > MAX_POLYNOM_DEGREE) exit(EXIT_BAD_DEGREE);
     p.degree = degree;
-    p.size = degree + 1;
-    p.coefficients = (bool*) malloc(p.size*sizeof(bool));
-    if (p.coefficients == NULL) exit(1);
-    for (pol_degree_t i = 0; i < degree; i++) {
-        p.coefficients[i] = false;
-    }
-    p.coefficients[degree] = true;
+    p.coefficients = allocate_words(POL_WORDS(degree + 1), &p.size);
+    set_coefficient(&p, degree, true);
     return p;
 }
 
 Polynomial_t constant_polynom(bool value) {
     Polynomial_t p = {0};
     p.degree = 0;
-    p.size = 1;
-    p.coefficients = (bool*) malloc(sizeof(bool));
-    if (p.coefficients == NULL) exit(1);
+    p.coefficients = allocate_words(1, &p.size);
     p.coefficients[0] = value;
     return p;
 }
@@ -37,49 +45,46 @@ Polynomial_t random_polynom(pol_degree_t degree) {
     Polynomial_t p = {0};
     if (degree > MAX_POLYNOM_DEGREE) exit(EXIT_BAD_DEGREE);
     p.degree = degree;
-    p.size = degree+1;
-    p.coefficients = (bool*) malloc(p.size*sizeof(bool));
-    if (p.coefficients == NULL) exit(1);
-    for (pol_degree_t i = 0; i <= degree; i++) {
-        // Assume that the random function has been seeded
-        p.coefficients[i] = rand() % 2;
-    }
+    uint64_t n_words = POL_WORDS(degree + 1);
+    p.coefficients = allocate_words(n_words, &p.size);
+    pol_random_fill(p.coefficients, n_words*sizeof(pol_word_t));
+    // Clear the coefficients above the degree
+    uint8_t top = degree % POL_WORD_BITS;
+    if (top != POL_WORD_BITS-1) p.coefficients[n_words-1] &= ((pol_word_t)1 << (top+1)) - 1;
+    set_coefficient(&p, degree, true);
     return p;
 }
 
 void copy_polynom(Polynomial_t src, Polynomial_t* dest) {
     if (dest == NULL) exit(1);
     dest->degree = src.degree;
-    dest->size = src.size;
-    dest->coefficients = (bool*) malloc(src.size*sizeof(bool));
-    for (pol_degree_t i = 0; i <= src.degree; i++) {
-        dest->coefficients[i] = src.coefficients[i];
-    }
+    dest->coefficients = allocate_words(POL_WORDS(src.degree + 1), &dest->size);
+    memcpy(dest->coefficients, src.coefficients, POL_WORDS(src.degree + 1)*sizeof(pol_word_t));
 }
 
 void delete_polynom(Polynomial_t p) {
     // Currently, if p.coefficients is uninitialized, this will cause a segfault
-    free(p.coefficients);
+    pol_release(p.coefficients, p.size / POL_WORD_BITS);
 }
 
 void add_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p) {
     if (p == NULL) exit(1);
-    p->size = MAX(p1.degree, p2.degree) + 1;
-    p->coefficients = (bool*) malloc(p->size*sizeof(bool));
-    if (p->coefficients == NULL) exit(1);
-
-    for (pol_degree_t i = 0; i < p->size; i++) {
-        if (i > p1.degree) p->coefficients[i] = p2.coefficients[i];
-        else if (i > p2.degree) p->coefficients[i] = p1.coefficients[i];
-        else p->coefficients[i] = p1.coefficients[i] ^ p2.coefficients[i];
-    }
+    uint64_t n1 = POL_WORDS(p1.degree + 1);
+    uint64_t n2 = POL_WORDS(p2.degree + 1);
+    uint64_t n = MAX(n1, n2);
+    pol_degree_t size;
+    pol_word_t* coefficients = allocate_words(n, &size);
 
-    if (p1.degree != p2.degree) p->degree = MAX(p1.degree, p2.degree);
-    else {
-        p->degree = degree_of_polynom(*p);
-        p->size = p->degree + 1;
-        p->coefficients = (bool*) realloc(p->coefficients, p->size*sizeof(bool));
+    for (uint64_t i = 0; i < n; i++) {
+        if (i >= n1) coefficients[i] = p2.coefficients[i];
+        else if (i >= n2) coefficients[i] = p1.coefficients[i];
+        else coefficients[i] = p1.coefficients[i] ^ p2.coefficients[i];
     }
+
+    p->coefficients = coefficients;
+    p->size = size;
+    p->degree = MAX(p1.degree, p2.degree);
+    if (p1.degree == p2.degree) p->degree = degree_of_polynom(*p);
 }
 
 void substract_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p) {
@@ -89,55 +94,209 @@ void substract_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p) {
 
 void multiply_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p) {
     if (p == NULL) exit(1);
-    // This is done to avoid problems if p is pointing to one of the original polynomals
-    Polynomial_t p1c, p2c;
-    copy_polynom(p1, &p1c);
-    copy_polynom(p2, &p2c);
-    p->degree = p1c.degree + p2c.degree;
-    p->size = p->degree + 1;
-    // if (&p1 == p || &p2 == p) delete_polynom(*p);  // Make sure we don't have any memory leaks
-    p->coefficients = (bool*) malloc(p->size * sizeof(bool));
-    if (p->coefficients == NULL) exit(1);
-    for (pol_degree_t i = 0; i < p->size; i++) p->coefficients[i] = false;
-    
-    for (pol_degree_t i = 0; i <= p1c.degree; i++) {
-        for (pol_degree_t j = 0; j <= p2c.degree; j++) {
-            p->coefficients[i+j] ^= p1c.coefficients[i] & p2c.coefficients[j];
+    // The result is built in a separate buffer, so p may point to one of the original polynomials
+    Polynomial_t product = {0};
+    mul_add_into(&product, p1, p2);
+    *p = product;
+}
+
+
+// Makes p hold at least n_words words, keeping its coefficients
+// Words past the degree are always null, so the new ones are ready to accumulate into
+static void reserve_words(Polynomial_t* p, uint64_t n_words) {
+    uint64_t capacity = p->size / POL_WORD_BITS;
+    if (n_words <= capacity) return;
+    // A borrowed array has no capacity, and may hold more words than asked for
+    uint64_t used = p->coefficients != NULL ? POL_WORDS(p->degree + 1) : 0;
+    pol_degree_t size;
+    pol_word_t* coefficients = allocate_words(MAX(n_words, used), &size);
+    if (p->coefficients != NULL) {
+        memcpy(coefficients, p->coefficients, used*sizeof(pol_word_t));
+        pol_release(p->coefficients, capacity);
+    }
+    p->coefficients = coefficients;
+    p->size = size;
+}
+
+// Sets the degree of p once coefficients up to degree may have changed
+static void update_degree(Polynomial_t* p, pol_degree_t degree) {
+    p->degree = degree;
+    if (!get_coefficient(*p, degree)) p->degree = degree_of_polynom(*p);
+}
+
+// Adds the words of a into c, and returns false when a is c, which is then the null polynom
+static bool xor_words_into(Polynomial_t* c, Polynomial_t a) {
+    if (c == NULL) exit(1);
+    if (c->coefficients != NULL && c->coefficients == a.coefficients) {
+        // a + a = 0
+        if (c->size == 0) {
+            *c = constant_polynom(false);
+            return false;
         }
+        memset(c->coefficients, 0, POL_WORDS(c->degree + 1)*sizeof(pol_word_t));
+        c->degree = 0;
+        return false;
     }
+    uint64_t n = POL_WORDS(a.degree + 1);
+    reserve_words(c, n);
+    xor_words(c->coefficients, a.coefficients, n);
+    return true;
+}
+
+void xor_into(Polynomial_t* c, Polynomial_t a) {
+    if (xor_words_into(c, a)) update_degree(c, MAX(c->degree, a.degree));
+}
 
-    delete_polynom(p1c);
-    delete_polynom(p2c);
+void lazy_xor_into(Polynomial_t* c, Polynomial_t a) {
+    if (xor_words_into(c, a)) c->degree = MAX(c->degree, a.degree);
 }
 
+void normalize_polynom(Polynomial_t* p) {
+    if (p == NULL) exit(1);
+    if (p->coefficients != NULL && !get_coefficient(*p, p->degree)) p->degree = degree_of_polynom(*p);
+}
+
+void reserve_polynom(Polynomial_t* p, pol_degree_t degree) {
+    if (p == NULL) exit(1);
+    bool allocated = p->coefficients != NULL;
+    reserve_words(p, POL_WORDS((uint64_t)degree + 1));
+    if (!allocated) p->degree = 0;
+}
+
+void mul_add_into(Polynomial_t* c, Polynomial_t a, Polynomial_t b) {
+    if (c == NULL) exit(1);
+    if (c->coefficients != NULL && (c->coefficients == a.coefficients || c->coefficients == b.coefficients)) {
+        // The product must not be written over its factors
+        Polynomial_t product = {0};
+        mul_add_into(&product, a, b);
+        xor_into(c, product);
+        delete_polynom(product);
+        return;
+    }
+
+    // Monoms, constants and other sparse operands are multiplied with shifts
+    pol_degree_t exponents[POL_SPARSE_MAX_WEIGHT];
+    SparsePolynomial_t s = {exponents, 0};
+    if ((s.count = sparse_exponents(a, exponents, POL_SPARSE_MAX_WEIGHT)) <= POL_SPARSE_MAX_WEIGHT) {
+        sparse_mul_add_into(c, b, s);
+        if (c->coefficients == NULL) *c = constant_polynom(false);
+        return;
+    }
+    if ((s.count = sparse_exponents(b, exponents, POL_SPARSE_MAX_WEIGHT)) <= POL_SPARSE_MAX_WEIGHT) {
+        sparse_mul_add_into(c, a, s);
+        if (c->coefficients == NULL) *c = constant_polynom(false);
+        return;
+    }
+
+    uint64_t na = POL_WORDS(a.degree + 1);
+    uint64_t nb = POL_WORDS(b.degree + 1);
+    reserve_words(c, na + nb);
+    mul_words(a.coefficients, na, b.coefficients, nb, c->coefficients);
+    update_degree(c, MAX(c->degree, a.degree + b.degree));
+}
+
+void shift_xor_into(Polynomial_t* c, Polynomial_t a, pol_degree_t shift) {
+    if (c == NULL) exit(1);
+    uint64_t n = POL_WORDS(a.degree + 1);
+    uint64_t offset = shift / POL_WORD_BITS;
+    uint8_t bits = shift % POL_WORD_BITS;
+    if (c->coefficients != NULL && c->coefficients == a.coefficients) {
+        Polynomial_t copy;
+        copy_polynom(a, &copy);
+        shift_xor_into(c, copy, shift);
+        delete_polynom(copy);
+        return;
+    }
+    reserve_words(c, POL_WORDS((uint64_t)a.degree + shift + 1));
+    pol_word_t* r = c->coefficients + offset;
+    if (bits == 0) xor_words(r, a.coefficients, n);
+    else {
+        pol_word_t carry = shift_xor_words(r, a.coefficients, n, bits);
+        // The carry word only exists if a reaches it
+        if (carry) r[n] ^= carry;
+    }
+    update_degree(c, MAX(c->degree, a.degree + shift));
+}
+
+
+// Reads 64 coefficients of p starting at coefficient start, p must hold the word after them
+static inline pol_word_t read_window(const pol_word_t* p, uint64_t start) {
+    uint64_t w = start / POL_WORD_BITS;
+    uint8_t bits = start % POL_WORD_BITS;
+    if (bits == 0) return p[w];
+    return (p[w] >> bits) | (p[w+1] << (POL_WORD_BITS-bits));
+}
+
+// In-place euclidean division of r (degree dr) by d (degree dd, dd <= dr)
+// On return, r holds the remainder and q the quotient
+// r must hold POL_WORDS(dr-dd+1) + POL_WORDS(dd+1) words and q POL_WORDS(dr-dd+1) words
+// No memory is allocated: each quotient word is found from the top 64 coefficients of d, then removed from r in one pass over d
+static void long_division(pol_word_t* r, pol_degree_t dr, const pol_word_t* d, pol_degree_t dd, pol_word_t* q) {
+    uint64_t nd = POL_WORDS(dd + 1);
+    uint64_t nq = POL_WORDS(dr - dd + 1);
+    // Coefficients dd-63 to dd of d, the leading one on the top bit
+    pol_word_t top = dd >= POL_WORD_BITS-1 ? read_window(d, dd - (POL_WORD_BITS-1)) : d[0] << (POL_WORD_BITS-1 - dd);
+
+    for (uint64_t w = nq; w-- > 0;) {
+        // Coefficients of r facing the leading coefficient of d for quotient coefficients 64w to 64w+63
+        pol_word_t window = read_window(r, w*POL_WORD_BITS + dd);
+        pol_word_t word = 0;
+        for (uint8_t b = POL_WORD_BITS; b-- > 0;) {
+            if ((window >> b) & 1) {
+                word |= (pol_word_t)1 << b;
+                window ^= top >> (POL_WORD_BITS-1 - b);
+            }
+        }
+        q[w] = word;
+        if (word) clmul_words(&q[w], 1, d, nd, r + w);
+    }
+}
 
 void divide_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p) {
     if (p == NULL) exit(1);
-    if (p2.degree == 0 && p2.coefficients[0] == false) exit(EXIT_DIVISION_BY_ZERO);
-    // This is done to avoid problems with the original polynoms if p is pointing to one of them
-    Polynomial_t p1c, p2c;
-    copy_polynom(p1, &p1c);
-    copy_polynom(p2, &p2c);
-    p->degree = p1c.degree - p2c.degree;
-    p->size = p->degree + 1;
-    // if (&p1 == p || &p2 == p) delete_polynom(*p);  // Make sure we don't have any memory leaks
-    p->coefficients = (bool*)malloc(p->size * sizeof(bool));
-    if (p->coefficients == NULL) exit(EXIT_FAILURE);
-    for (pol_degree_t i = 0; i <= p->degree; i++) p->coefficients[i] = false;
-
-    Polynomial_t remainder = {0};
-    copy_polynom(p1c, &remainder);
-    while (remainder.degree >= p2c.degree) {
-        Polynomial_t monom_division = monom(remainder.degree - p2c.degree);
-        Polynomial_t monom_product = {0};
-        multiply_polynoms(monom_division, p2c, &monom_product);
-        substract_polynoms(remainder, monom_product, &remainder);
-        add_polynoms(*p, monom_division, p);
-        delete_polynom(monom_division);
-        delete_polynom(monom_product);
+    if (p2.degree == 0 && p2.coefficients[0] == 0) exit(EXIT_DIVISION_BY_ZERO);
+    if (p1.degree < p2.degree) {
+        *p = constant_polynom(false);
+        return;
     }
 
-    delete_polynom(remainder);
-    delete_polynom(p1c);
-    delete_polynom(p2c);
+    uint64_t nq = POL_WORDS(p1.degree - p2.degree + 1);
+    uint64_t nr = nq + POL_WORDS(p2.degree + 1);
+    pol_degree_t remainder_size, size;
+    pol_word_t* remainder = allocate_words(nr, &remainder_size);
+    memcpy(remainder, p1.coefficients, POL_WORDS(p1.degree + 1)*sizeof(pol_word_t));
+    pol_word_t* quotient = allocate_words(nq, &size);
+
+    long_division(remainder, p1.degree, p2.coefficients, p2.degree, quotient);
+    pol_release(remainder, remainder_size / POL_WORD_BITS);
+
+    p->coefficients = quotient;
+    p->size = size;
+    p->degree = p1.degree - p2.degree;
+    // Dividend of lower degree than its apparent one
+    if (!get_coefficient(*p, p->degree)) p->degree = degree_of_polynom(*p);
+}
+
+void modulo_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p) {
+    if (p == NULL) exit(1);
+    if (p2.degree == 0 && p2.coefficients[0] == 0) exit(EXIT_DIVISION_BY_ZERO);
+    if (p1.degree < p2.degree) {
+        copy_polynom(p1, p);
+        return;
+    }
+
+    uint64_t nq = POL_WORDS(p1.degree - p2.degree + 1);
+    uint64_t nr = nq + POL_WORDS(p2.degree + 1);
+    pol_degree_t size;
+    pol_word_t* remainder = allocate_words(nr + nq, &size);
+    memcpy(remainder, p1.coefficients, POL_WORDS(p1.degree + 1)*sizeof(pol_word_t));
+
+    // The quotient goes behind the remainder, and is cleared afterwards
+    long_division(remainder, p1.degree, p2.coefficients, p2.degree, remainder + nr);
+    memset(remainder + nr, 0, nq*sizeof(pol_word_t));
+
+    p->coefficients = remainder;
+    p->size = size;
+    p->degree = p2.degree ? p2.degree - 1 : 0;
+    p->degree = degree_of_polynom(*p);
 }
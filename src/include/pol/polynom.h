@@ -4,13 +4,15 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-#include <emmintrin.h>
-
 #include "utils.h"
 
 #define pol_degree_t uint32_t
 #define MAX_POLYNOM_DEGREE 4294967295
 
+#define pol_word_t uint64_t
+#define POL_WORD_BITS 64
+#define POL_WORDS(n) (((uint64_t)(n) + POL_WORD_BITS - 1) / POL_WORD_BITS)
+
 #define EXIT_BAD_DEGREE 2
 #define EXIT_BAD_COEFFICIENT 3
 #define EXIT_DIVISION_BY_ZERO 4
@@ -30,22 +32,61 @@
 /**
  * @brief Polynomial_t structure
  * 
- * This structure is used to represent a polynom. It contains a pointer to an array of booleans, which represents the coefficients of the polynom in Z/2Z, and the degree of the polynom.
- * Degree is such that coefficients[degree] = 1 and coefficients[i] = 0 for i > degree.
+ * This structure is used to represent a polynom. It contains a pointer to an array of words, which packs the coefficients of the polynom in Z/2Z, and the degree of the polynom.
+ * Coefficient i is stored in bit (i % POL_WORD_BITS) of word (i / POL_WORD_BITS).
+ * Degree is such that coefficient degree is 1 and coefficient i is 0 for i > degree, including the unused bits of the last words.
+ * A polynom with a borrowed array is read-only: deleting it does nothing, and the accumulate functions move it to a buffer of its own before writing.
+ * The array may hold more coefficients than the degree needs, so that accumulating into a polynom does not reallocate it every time.
  * 
- * @param coefficients Pointer to an array of booleans, which represents the coefficients of the polynomial in Z/2Z.
+ * @param coefficients Pointer to an array of words, which packs the coefficients of the polynomial in Z/2Z.
  * @param degree Degree of the polynomial.
- * @param size Size of the coefficients array.
+ * @param size Number of coefficients the array can hold (always a multiple of POL_WORD_BITS), or 0 if the array is borrowed from another structure.
  * 
  * @see pol_degree_t
+ * @see get_coefficient
+ * @see set_coefficient
 */
 typedef struct {
-    bool* coefficients;
+    pol_word_t* coefficients;
     pol_degree_t degree;
     pol_degree_t size;
 } Polynomial_t;
 
 
+/**
+ * @brief Read a coefficient
+ * 
+ * This function returns the coefficient of degree i of the given polynom.
+ * 
+ * @param[in] p Polynom to read.
+ * @param[in] i Degree of the coefficient, must be lower than p.size.
+ * @return Coefficient of degree i.
+ * 
+ * @see Polynomial_t
+*/
+static inline bool get_coefficient(Polynomial_t p, pol_degree_t i) {
+    return (p.coefficients[i / POL_WORD_BITS] >> (i % POL_WORD_BITS)) & 1;
+}
+
+/**
+ * @brief Write a coefficient
+ * 
+ * This function sets the coefficient of degree i of the given polynom.
+ * The degree of the polynom is not updated.
+ * 
+ * @param[in,out] p Polynom to modify.
+ * @param[in] i Degree of the coefficient, must be lower than p->size.
+ * @param[in] value New value of the coefficient.
+ * 
+ * @see Polynomial_t
+*/
+static inline void set_coefficient(Polynomial_t* p, pol_degree_t i, bool value) {
+    pol_word_t mask = (pol_word_t)1 << (i % POL_WORD_BITS);
+    if (value) p->coefficients[i / POL_WORD_BITS] |= mask;
+    else p->coefficients[i / POL_WORD_BITS] &= ~mask;
+}
+
+
 /**
  * @brief Create a new monomial
  * 
@@ -74,14 +115,15 @@ Polynomial_t constant_polynom(bool value);
  * @brief Create a random polynom
  * 
  * This function creates a new polynom with the given degree. The coefficients of the polynom are initialized to random values.
+ * The leading coefficient is always set to 1, so that the polynom has exactly the given degree.
  * 
  * @param[in] degree Degree of the polynom.
  * @return Polynomial with random coefficients.
  * 
- * @note This function assumes that the random function has been seeded.
+ * @note The coefficients are drawn from the current random source, a whole word at a time.
  * 
  * @see Polynomial_t
- * @see rand
+ * @see pol_random_fill
 */
 Polynomial_t random_polynom(pol_degree_t degree);
 
@@ -113,7 +155,7 @@ void delete_polynom(Polynomial_t p);
  * @brief Add two polynoms
  * 
  * This function adds two polynoms and returns the result.
- * Will use SSE2 instructions if available.
+ * Coefficients are added a whole word at a time.
  * 
  * @param[in] p1 First polynom.
  * @param[in] p2 Second polynom.
@@ -127,7 +169,7 @@ void add_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p);
  * @brief Substract two polynoms
  * 
  * This function substracts two polynoms and returns the result.
- * Will use SSE2 instructions if available.
+ * Coefficients are substracted a whole word at a time.
  * 
  * @param[in] p1 First polynom.
  * @param[in] p2 Second polynom.
@@ -143,13 +185,15 @@ void substract_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p);
  * @brief Multiply two polynoms
  * 
  * This function multiplies two polynoms and returns the result.
- * Will use SSE2 instructions if available.
+ * Large polynoms are split with Karatsuba or Toom-3, down to the carry-less multiplication kernels, using PCLMULQDQ or VPCLMULQDQ if available.
+ * If one of them has at most POL_SPARSE_MAX_WEIGHT coefficients, such as a monom, the product is a sum of shifts instead.
  * 
  * @param[in] p1 First polynom.
  * @param[in] p2 Second polynom.
  * @param[out] p Pointer to the result polynom.
  * 
  * @see Polynomial_t
+ * @see mul_words
 */
 void multiply_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p);
 
@@ -157,7 +201,7 @@ void multiply_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p);
  * @brief Divide two polynoms
  * 
  * This function divides two polynoms and returns the quotient (euclidean division).
- * Will use SSE2 instructions if available.
+ * The division is done in place on a single copy of p1, 64 quotient coefficients at a time.
  * 
  * @param[in] p1 First polynom.
  * @param[in] p2 Second polynom.
@@ -166,3 +210,104 @@ void multiply_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p);
  * @see Polynomial_t
 */
 void divide_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p);
+
+/**
+ * @brief Remainder of the division of two polynoms
+ * 
+ * This function divides two polynoms and returns the remainder (euclidean division).
+ * The division is done in place on a single copy of p1, 64 quotient coefficients at a time.
+ * 
+ * @param[in] p1 First polynom.
+ * @param[in] p2 Second polynom.
+ * @param[out] p Pointer to the result polynom.
+ * 
+ * @see Polynomial_t
+*/
+void modulo_polynoms(Polynomial_t p1, Polynomial_t p2, Polynomial_t* p);
+
+/**
+ * @brief Add a polynom into another
+ * 
+ * This function computes c += a in place.
+ * The buffer of c only grows when a has more words than it can hold, so a sequence of additions reuses the same buffer.
+ * c may be a null polynom {0}, which is then allocated. a may be c itself.
+ * 
+ * @param[in,out] c Pointer to the accumulator polynom.
+ * @param[in] a Polynom to add.
+ * 
+ * @see Polynomial_t
+*/
+void xor_into(Polynomial_t* c, Polynomial_t a);
+
+/**
+ * @brief Add a product of polynoms into another
+ * 
+ * This function computes c += a*b in place, with the same algorithms as multiply_polynoms.
+ * The product is accumulated directly in the buffer of c, so no temporary polynom is created unless c is a or b.
+ * Sparse operands are handled with shifts, as in multiply_polynoms.
+ * c may be a null polynom {0}, which is then allocated.
+ * 
+ * @param[in,out] c Pointer to the accumulator polynom.
+ * @param[in] a First factor.
+ * @param[in] b Second factor.
+ * 
+ * @see Polynomial_t
+ * @see multiply_polynoms
+*/
+void mul_add_into(Polynomial_t* c, Polynomial_t a, Polynomial_t b);
+
+/**
+ * @brief Add a shifted polynom into another
+ * 
+ * This function computes c += a*X^shift in place.
+ * c may be a null polynom {0}, which is then allocated. a may be c itself.
+ * 
+ * @param[in,out] c Pointer to the accumulator polynom.
+ * @param[in] a Polynom to shift and add.
+ * @param[in] shift Power of X to multiply a by.
+ * 
+ * @see Polynomial_t
+*/
+void shift_xor_into(Polynomial_t* c, Polynomial_t a, pol_degree_t shift);
+
+/**
+ * @brief Add a polynom into another, leaving its degree unnormalized
+ * 
+ * This function computes c += a in place like xor_into, but without looking for the degree of the sum:
+ * the degree of c becomes the largest of the two degrees, which is only an upper bound when the leading coefficients cancel.
+ * Sums of many polynoms of the same degree, such as ciphertexts, then find their degree once, with normalize_polynom, instead of at every step.
+ * Until it is normalized, c may only be given to lazy_xor_into, normalize_polynom, reserve_polynom or delete_polynom.
+ * a may be unnormalized too.
+ * 
+ * @param[in,out] c Pointer to the accumulator polynom.
+ * @param[in] a Polynom to add.
+ * 
+ * @see xor_into
+ * @see normalize_polynom
+*/
+void lazy_xor_into(Polynomial_t* c, Polynomial_t a);
+
+/**
+ * @brief Find the degree of a polynom
+ * 
+ * This function lowers the degree of p to the one of its leading coefficient, after lazy_xor_into.
+ * It only scans the words of p when its apparent leading coefficient is 0.
+ * 
+ * @param[in,out] p Pointer to the polynom.
+ * 
+ * @see lazy_xor_into
+*/
+void normalize_polynom(Polynomial_t* p);
+
+/**
+ * @brief Reserve room in a polynom
+ * 
+ * This function makes the array of p hold at least degree + 1 coefficients, keeping them, so that sums up to that degree do not reallocate it.
+ * p may be a null polynom {0}, which is then allocated and stays null.
+ * 
+ * @param[in,out] p Pointer to the polynom.
+ * @param[in] degree Degree the polynom must be able to reach.
+ * 
+ * @see xor_into
+*/
+void reserve_polynom(Polynomial_t* p, pol_degree_t degree);
@@ -0,0 +1,126 @@
+#include "pool.h"
+
+#include <string.h>
+
+
+// Buffers of up to 2^POOL_MAX_BITS words are kept in the free lists
+#define POOL_MAX_BITS 22
+#define POOL_CLASSES (8 + 4*(POOL_MAX_BITS-3))
+// A thread keeps at most 128 MiB in its free lists
+#define POOL_MAX_CACHED_WORDS ((uint64_t)1 << 24)
+
+typedef struct {
+    pol_word_t* free_lists[POOL_CLASSES];
+    PolPoolStats stats;
+} PoolCache;
+
+static _Thread_local PoolCache cache;
+
+
+// Size classes: 1, 2, ..., 8, then 4 classes per power of two: 10, 12, 14, 16, 20, 24, 28, 32, ...
+static uint8_t size_class(uint64_t n_words, uint64_t* capacity) {
+    if (n_words <= 8) {
+        *capacity = n_words;
+        return n_words - 1;
+    }
+    uint8_t e = POL_WORD_BITS-1 - __builtin_clzll(n_words - 1);
+    uint64_t k = (n_words - 1) >> (e-2);
+    *capacity = (k+1) << (e-2);
+    return 8 + 4*(e-3) + (k-4);
+}
+
+static uint64_t class_capacity(uint8_t c) {
+    if (c < 8) return c+1;
+    uint8_t e = 3 + (c-8)/4;
+    uint64_t k = 4 + (c-8)%4;
+    return (k+1) << (e-2);
+}
+
+static pol_word_t* pool_allocate(uint64_t n_words, uint64_t* capacity) {
+    if (n_words == 0) n_words = 1;
+    if (n_words > ((uint64_t)1 << POOL_MAX_BITS)) {
+        cache.stats.system_allocations++;
+        *capacity = n_words;
+        return (pol_word_t*) calloc(n_words, sizeof(pol_word_t));
+    }
+
+    uint8_t c = size_class(n_words, capacity);
+    pol_word_t* words = cache.free_lists[c];
+    if (words == NULL) {
+        cache.stats.system_allocations++;
+        return (pol_word_t*) calloc(*capacity, sizeof(pol_word_t));
+    }
+    // Free buffers link to the next one through their first word
+    cache.free_lists[c] = (pol_word_t*)(uintptr_t)words[0];
+    cache.stats.cached_words -= *capacity;
+    memset(words, 0, *capacity*sizeof(pol_word_t));
+    return words;
+}
+
+static void pool_release(pol_word_t* words, uint64_t capacity) {
+    if (words == NULL) return;
+    if (capacity == 0 || capacity > ((uint64_t)1 << POOL_MAX_BITS) || cache.stats.cached_words + capacity > POOL_MAX_CACHED_WORDS) {
+        cache.stats.system_releases++;
+        free(words);
+        return;
+    }
+
+    uint64_t rounded;
+    uint8_t c = size_class(capacity, &rounded);
+    // A buffer that is not of a class size goes to the class below
+    if (rounded != capacity) capacity = class_capacity(--c);
+    words[0] = (pol_word_t)(uintptr_t)cache.free_lists[c];
+    cache.free_lists[c] = words;
+    cache.stats.cached_words += capacity;
+}
+
+static pol_word_t* system_allocate(uint64_t n_words, uint64_t* capacity) {
+    if (n_words == 0) n_words = 1;
+    *capacity = n_words;
+    return (pol_word_t*) calloc(n_words, sizeof(pol_word_t));
+}
+
+static void system_release(pol_word_t* words, uint64_t capacity) {
+    (void)capacity;
+    free(words);
+}
+
+
+const PolAllocator pol_pool_allocator = {pool_allocate, pool_release};
+const PolAllocator pol_system_allocator = {system_allocate, system_release};
+
+static PolAllocator allocator = {pool_allocate, pool_release};
+
+void set_pol_allocator(PolAllocator a) {
+    allocator = a;
+}
+
+pol_word_t* pol_allocate(uint64_t n_words, uint64_t* capacity) {
+    uint64_t c;
+    pol_word_t* words = allocator.allocate(n_words, &c);
+    if (words == NULL) exit(1);
+    if (capacity != NULL) *capacity = c;
+    return words;
+}
+
+void pol_release(pol_word_t* words, uint64_t capacity) {
+    // Borrowed buffers belong to someone else
+    if (capacity == 0) return;
+    allocator.release(words, capacity);
+}
+
+void pol_pool_trim(void) {
+    for (uint8_t c = 0; c < POOL_CLASSES; c++) {
+        while (cache.free_lists[c] != NULL) {
+            pol_word_t* words = cache.free_lists[c];
+            cache.free_lists[c] = (pol_word_t*)(uintptr_t)words[0];
+            free(words);
+            cache.stats.system_releases++;
+        }
+    }
+    cache.stats.cached_words = 0;
+}
+
+PolPoolStats pol_pool_stats(void) {
+    return cache.stats;
+}
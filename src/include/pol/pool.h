@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "polynom.h"
+
+
+/**
+ * @file pool.h
+ * @brief Allocation of polynomial buffers.
+ *
+ * Every coefficient buffer and every temporary of the polynomial functions is obtained from the current PolAllocator.
+ * The default allocator is a pool: each thread keeps freed buffers in free lists by size class, and hands them back on the next allocation of that class.
+ * Once the lists hold the buffers of a computation, running it again does not call malloc or free anymore.
+ * Size classes are spaced by a quarter of a power of two, so a buffer wastes less than 25% of its memory.
+ *
+ * @see PolAllocator
+*/
+
+
+/**
+ * @brief PolAllocator structure
+ *
+ * This structure holds the functions used to get and give back word buffers.
+ * allocate must return a zeroed buffer of at least n_words words and write its real capacity.
+ * release receives a buffer with the capacity returned by allocate, or NULL.
+ *
+ * @param allocate Function returning a buffer of n_words words.
+ * @param release Function giving back a buffer.
+*/
+typedef struct {
+    pol_word_t* (*allocate)(uint64_t n_words, uint64_t* capacity);
+    void (*release)(pol_word_t* words, uint64_t capacity);
+} PolAllocator;
+
+/**
+ * @brief PolPoolStats structure
+ *
+ * Counters of the pool of the calling thread.
+ *
+ * @param system_allocations Number of buffers obtained from the system.
+ * @param system_releases Number of buffers given back to the system.
+ * @param cached_words Number of words held in the free lists.
+*/
+typedef struct {
+    uint64_t system_allocations;
+    uint64_t system_releases;
+    uint64_t cached_words;
+} PolPoolStats;
+
+/**
+ * @brief Pool allocator, the default one
+*/
+extern const PolAllocator pol_pool_allocator;
+
+/**
+ * @brief Allocator calling calloc and free directly
+*/
+extern const PolAllocator pol_system_allocator;
+
+/**
+ * @brief Set the allocator
+ *
+ * This function replaces the allocator of the whole process.
+ * It must be called before any polynom is created, as buffers are given back to the allocator that is current when they are deleted.
+ *
+ * @param[in] allocator New allocator.
+ *
+ * @see PolAllocator
+*/
+void set_pol_allocator(PolAllocator allocator);
+
+/**
+ * @brief Allocate a zeroed buffer of words
+ *
+ * @param[in] n_words Number of words needed.
+ * @param[out] capacity Pointer to the real number of words of the buffer, may be NULL.
+ * @return The buffer. The program exits if no memory is left.
+*/
+pol_word_t* pol_allocate(uint64_t n_words, uint64_t* capacity);
+
+/**
+ * @brief Give back a buffer of words
+ *
+ * @param[in] words Buffer to give back, may be NULL.
+ * @param[in] capacity Capacity returned when the buffer was allocated, or 0 for a buffer that was not allocated here, which is then left alone.
+*/
+void pol_release(pol_word_t* words, uint64_t capacity);
+
+/**
+ * @brief Empty the pool of the calling thread
+ *
+ * This function gives the buffers held by the free lists of the calling thread back to the system.
+ * It should be called once a burst of computations is over, and before a thread that used polynoms exits.
+*/
+void pol_pool_trim(void);
+
+/**
+ * @brief Get the counters of the pool of the calling thread
+ *
+ * @return Counters of the pool.
+ *
+ * @see PolPoolStats
+*/
+PolPoolStats pol_pool_stats(void);
@@ -0,0 +1,160 @@
+#include "random.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils.h"
+
+#if defined(__linux__)
+#include <sys/random.h>
+#endif
+
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = ROTL32(d, 16); \
+    c += d; b ^= c; b = ROTL32(b, 12); \
+    a += b; d ^= a; d = ROTL32(d, 8); \
+    c += d; b ^= c; b = ROTL32(b, 7);
+
+static inline uint32_t load32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void store32(uint8_t* p, uint32_t x) {
+    p[0] = x;
+    p[1] = x >> 8;
+    p[2] = x >> 16;
+    p[3] = x >> 24;
+}
+
+// "expand 32-byte k"
+static const uint32_t sigma[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+
+// 20 rounds on the 16 words of input, then the words are added back
+static void chacha20_core(const uint32_t input[16], uint8_t block[64]) {
+    uint32_t x[16];
+    memcpy(x, input, sizeof(x));
+    for (uint8_t i = 0; i < 10; i++) {
+        QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+        QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+        QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+        QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+    }
+    for (uint8_t i = 0; i < 16; i++) store32(block + 4*i, x[i] + input[i]);
+}
+
+void chacha20_block(const uint8_t key[32], uint32_t counter, const uint8_t nonce[12], uint8_t block[64]) {
+    uint32_t input[16];
+    memcpy(input, sigma, sizeof(sigma));
+    for (uint8_t i = 0; i < 8; i++) input[4+i] = load32(key + 4*i);
+    input[12] = counter;
+    for (uint8_t i = 0; i < 3; i++) input[13+i] = load32(nonce + 4*i);
+    chacha20_core(input, block);
+}
+
+
+static void system_fill(void* buffer, uint64_t n_bytes) {
+    uint8_t* p = (uint8_t*) buffer;
+#if defined(__linux__)
+    while (n_bytes > 0) {
+        ssize_t n = getrandom(p, n_bytes, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            exit(EXIT_NO_ENTROPY);
+        }
+        p += n;
+        n_bytes -= n;
+    }
+#else
+    FILE* f = fopen("/dev/urandom", "rb");
+    if (f == NULL) exit(EXIT_NO_ENTROPY);
+    uint64_t n = fread(p, 1, n_bytes, f);
+    fclose(f);
+    if (n != n_bytes) exit(EXIT_NO_ENTROPY);
+#endif
+}
+
+
+// Stream of a thread: the key, a 64-bit block counter in words 12 and 13, and the unused bytes of the last block
+typedef struct {
+    uint32_t input[16];
+    uint8_t block[64];
+    uint8_t available;
+    bool seeded;
+} ChaChaStream;
+
+static _Thread_local ChaChaStream stream;
+
+// The child of a fork would draw the same bytes as its parent, so its stream is keyed again on first use
+static void stream_forget(void) {
+    memset(&stream, 0, sizeof(stream));
+}
+
+static pthread_once_t fork_handler_once = PTHREAD_ONCE_INIT;
+
+static void register_fork_handler(void) {
+    if (pthread_atfork(NULL, NULL, stream_forget) != 0) exit(1);
+}
+
+static void stream_seed(const uint8_t seed[32]) {
+    // Only the forking thread lives on in the child, so forgetting its stream is enough
+    pthread_once(&fork_handler_once, register_fork_handler);
+    memcpy(stream.input, sigma, sizeof(sigma));
+    for (uint8_t i = 0; i < 8; i++) stream.input[4+i] = load32(seed + 4*i);
+    for (uint8_t i = 12; i < 16; i++) stream.input[i] = 0;
+    stream.available = 0;
+    stream.seeded = true;
+}
+
+static inline void stream_next_block(uint8_t block[64]) {
+    chacha20_core(stream.input, block);
+    if (++stream.input[12] == 0) stream.input[13]++;
+}
+
+static void chacha20_fill(void* buffer, uint64_t n_bytes) {
+    if (!stream.seeded) {
+        uint8_t seed[32];
+        system_fill(seed, sizeof(seed));
+        stream_seed(seed);
+    }
+    uint8_t* p = (uint8_t*) buffer;
+
+    // Bytes left from the previous call, then whole blocks straight to the buffer
+    uint64_t n = MIN((uint64_t)stream.available, n_bytes);
+    memcpy(p, stream.block + 64 - stream.available, n);
+    stream.available -= n;
+    p += n;
+    n_bytes -= n;
+    for (; n_bytes >= 64; n_bytes -= 64, p += 64) stream_next_block(p);
+    if (n_bytes > 0) {
+        stream_next_block(stream.block);
+        memcpy(p, stream.block, n_bytes);
+        stream.available = 64 - n_bytes;
+    }
+}
+
+
+const PolRandom pol_random_chacha20 = {chacha20_fill};
+const PolRandom pol_random_system = {system_fill};
+
+static PolRandom source = {chacha20_fill};
+
+void set_pol_random(PolRandom s) {
+    source = s;
+}
+
+void pol_random_fill(void* buffer, uint64_t n_bytes) {
+    source.fill(buffer, n_bytes);
+}
+
+void pol_random_seed(const uint8_t seed[32]) {
+    stream_seed(seed);
+}
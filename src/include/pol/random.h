@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define EXIT_NO_ENTROPY 5
+
+
+/**
+ * @file random.h
+ * @brief Random source of polynoms and parts.
+ *
+ * Every random coefficient of the library is drawn from the current PolRandom source, a whole buffer at a time.
+ * The default source is ChaCha20: each thread runs its own stream, keyed from the system entropy (getrandom) on first use.
+ * A stream can be given a fixed seed to replay a computation.
+ * The child of a fork keys its stream again from the system entropy, even if the parent seeded it, so that parent and child never draw the same bytes.
+ *
+ * @see PolRandom
+*/
+
+
+/**
+ * @brief PolRandom structure
+ *
+ * This structure holds the function used to get random bytes.
+ * fill must write n_bytes random bytes to buffer, and be safe to call from several threads.
+ *
+ * @param fill Function filling a buffer with random bytes.
+*/
+typedef struct {
+    void (*fill)(void* buffer, uint64_t n_bytes);
+} PolRandom;
+
+/**
+ * @brief ChaCha20 source, the default one
+*/
+extern const PolRandom pol_random_chacha20;
+
+/**
+ * @brief Source reading the system entropy for every call
+*/
+extern const PolRandom pol_random_system;
+
+/**
+ * @brief Set the random source
+ *
+ * This function replaces the random source of the whole process.
+ * It must not be called while random polynoms or parts are being generated.
+ *
+ * @param[in] source New random source.
+ *
+ * @see PolRandom
+*/
+void set_pol_random(PolRandom source);
+
+/**
+ * @brief Fill a buffer with random bytes
+ *
+ * @param[out] buffer Buffer to fill.
+ * @param[in] n_bytes Number of bytes to write.
+*/
+void pol_random_fill(void* buffer, uint64_t n_bytes);
+
+/**
+ * @brief Seed the ChaCha20 stream of the calling thread
+ *
+ * The stream restarts from the given key, so the random values that follow are the same for the same seed.
+ * This is meant for tests and benchmarks: a fixed seed makes the keys predictable.
+ *
+ * @param[in] seed Key of 32 bytes.
+*/
+void pol_random_seed(const uint8_t seed[32]);
+
+/**
+ * @brief Compute a ChaCha20 block
+ *
+ * This function computes the block of RFC 8439 for the given key, block counter and nonce.
+ *
+ * @param[in] key Key of 32 bytes.
+ * @param[in] counter Block counter.
+ * @param[in] nonce Nonce of 12 bytes.
+ * @param[out] block The 64 bytes of the block.
+*/
+void chacha20_block(const uint8_t key[32], uint32_t counter, const uint8_t nonce[12], uint8_t block[64]);
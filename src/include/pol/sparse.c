@@ -0,0 +1,50 @@
+#include "sparse.h"
+
+
+uint64_t sparse_exponents(Polynomial_t p, pol_degree_t* exponents, uint64_t max_count) {
+    uint64_t count = 0;
+    uint64_t n = POL_WORDS(p.degree + 1);
+    for (uint64_t w = 0; w < n; w++) {
+        for (pol_word_t word = p.coefficients[w]; word; word &= word-1) {
+            if (count == max_count) return max_count+1;
+            exponents[count++] = (pol_degree_t)(w*POL_WORD_BITS + __builtin_ctzll(word));
+        }
+    }
+    return count;
+}
+
+SparsePolynomial_t sparse_polynom(Polynomial_t p) {
+    SparsePolynomial_t s = {0};
+    uint64_t n = POL_WORDS(p.degree + 1);
+    for (uint64_t w = 0; w < n; w++) s.count += __builtin_popcountll(p.coefficients[w]);
+    s.exponents = (pol_degree_t*) malloc(MAX(s.count, 1)*sizeof(pol_degree_t));
+    if (s.exponents == NULL) exit(1);
+    sparse_exponents(p, s.exponents, s.count);
+    return s;
+}
+
+Polynomial_t dense_polynom(SparsePolynomial_t s) {
+    Polynomial_t p = {0};
+    sparse_xor_into(&p, s);
+    if (p.coefficients == NULL) p = constant_polynom(false);
+    return p;
+}
+
+void delete_sparse_polynom(SparsePolynomial_t s) {
+    free(s.exponents);
+}
+
+void sparse_xor_into(Polynomial_t* c, SparsePolynomial_t s) {
+    if (c == NULL) exit(1);
+    // The shift of the constant 1 flips a single coefficient
+    // Highest exponent first, so that c grows once
+    pol_word_t word = 1;
+    Polynomial_t one = {&word, 0, 0};
+    for (uint64_t i = s.count; i-- > 0;) shift_xor_into(c, one, s.exponents[i]);
+}
+
+void sparse_mul_add_into(Polynomial_t* c, Polynomial_t a, SparsePolynomial_t s) {
+    if (c == NULL) exit(1);
+    if (c->coefficients != NULL && c->coefficients == a.coefficients) exit(1);
+    for (uint64_t i = s.count; i-- > 0;) shift_xor_into(c, a, s.exponents[i]);
+}
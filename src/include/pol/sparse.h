@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "polynom.h"
+
+// Operands with at most this many coefficients are multiplied with shifts
+#define POL_SPARSE_MAX_WEIGHT 8
+
+
+/**
+ * @file sparse.h
+ * @brief Sparse polynoms and their fast paths.
+ *
+ * Monoms, constants and other polynoms with few coefficients are better handled as a list of exponents.
+ * Multiplying by such a polynom is a sum of shifts, which costs a pass over the other operand per exponent instead of a full multiplication.
+ * mul_add_into, and so multiply_polynoms, use these kernels automatically when an operand has at most POL_SPARSE_MAX_WEIGHT coefficients.
+ *
+ * @see SparsePolynomial_t
+*/
+
+
+/**
+ * @brief SparsePolynomial_t structure
+ *
+ * This structure represents a polynom by the exponents of its coefficients equal to 1, in increasing order.
+ * The null polynom has no exponent.
+ *
+ * @param exponents Pointer to the array of exponents.
+ * @param count Number of exponents.
+*/
+typedef struct {
+    pol_degree_t* exponents;
+    uint64_t count;
+} SparsePolynomial_t;
+
+/**
+ * @brief List the exponents of a polynom
+ *
+ * This function writes the exponents of the coefficients of p equal to 1, in increasing order, and stops after max_count of them.
+ *
+ * @param[in] p Polynom to read.
+ * @param[out] exponents Array of max_count exponents.
+ * @param[in] max_count Maximum number of exponents to write.
+ * @return Number of exponents of p, or max_count+1 if p has more than max_count of them.
+*/
+uint64_t sparse_exponents(Polynomial_t p, pol_degree_t* exponents, uint64_t max_count);
+
+/**
+ * @brief Create a sparse polynom
+ *
+ * @param[in] p Polynom to convert.
+ * @return Sparse polynom with the coefficients of p.
+ *
+ * @see SparsePolynomial_t
+*/
+SparsePolynomial_t sparse_polynom(Polynomial_t p);
+
+/**
+ * @brief Create a dense polynom from a sparse one
+ *
+ * @param[in] s Sparse polynom to convert.
+ * @return Polynom with the coefficients of s.
+ *
+ * @see SparsePolynomial_t
+*/
+Polynomial_t dense_polynom(SparsePolynomial_t s);
+
+/**
+ * @brief Delete a sparse polynom
+ *
+ * @param[in] s Sparse polynom to delete.
+*/
+void delete_sparse_polynom(SparsePolynomial_t s);
+
+/**
+ * @brief Add a sparse polynom into a polynom
+ *
+ * This function computes c += s by flipping one coefficient per exponent.
+ * Adding a constant or a monom this way needs no temporary polynom.
+ *
+ * @param[in,out] c Pointer to the accumulator polynom, may be a null polynom {0}.
+ * @param[in] s Sparse polynom to add.
+*/
+void sparse_xor_into(Polynomial_t* c, SparsePolynomial_t s);
+
+/**
+ * @brief Add the product of a polynom and a sparse polynom into a polynom
+ *
+ * This function computes c += a*s as the sum of the shifts of a by the exponents of s.
+ * c must not be a.
+ *
+ * @param[in,out] c Pointer to the accumulator polynom, may be a null polynom {0}.
+ * @param[in] a Dense factor.
+ * @param[in] s Sparse factor.
+ *
+ * @see shift_xor_into
+*/
+void sparse_mul_add_into(Polynomial_t* c, Polynomial_t a, SparsePolynomial_t s);
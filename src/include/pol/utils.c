@@ -1,13 +1,18 @@
 #include "utils.h"
 
+#include "random.h"
+
 Part random_part(uint64_t size) {
     Part part = {0};
     part.size = size;
     part.elements = (bool*) malloc(size * sizeof(bool));
     if (part.elements == NULL) exit(1);
+    // Each random word gives 64 elements
+    uint64_t words[64];
     for (uint64_t i = 0; i < size; i++) {
-        // Assume that the random function has been seeded
-        part.elements[i] = rand() % 2;
+        uint64_t k = i % (64*64);
+        if (k == 0) pol_random_fill(words, MIN(sizeof(words), (size - i + 63) / 64 * sizeof(uint64_t)));
+        part.elements[i] = (words[k / 64] >> (k % 64)) & 1;
     }
     return part;
 }
@@ -8,6 +8,7 @@
 #include <stdio.h>
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
 /**
  * @file utils.h
@@ -48,7 +49,7 @@ typedef struct {
  * @param[in] size Size of the part.
  * @return New random part.
  * 
- * @note The random function must be seeded before calling this function.
+ * @note The elements are drawn from the current random source, 64 elements per random word.
  * 
  * @see Part
 */
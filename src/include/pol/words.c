@@ -0,0 +1,205 @@
+#include "words.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define WORDS_X86
+#endif
+
+
+static void xor_words_portable(pol_word_t* dst, const pol_word_t* src, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) dst[i] ^= src[i];
+}
+
+static pol_word_t shift_xor_words_portable(pol_word_t* dst, const pol_word_t* src, uint64_t n, uint8_t bits) {
+    pol_word_t carry = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        dst[i] ^= (src[i] << bits) | carry;
+        carry = src[i] >> (POL_WORD_BITS-bits);
+    }
+    return carry;
+}
+
+static uint64_t used_words_portable(const pol_word_t* p, uint64_t n) {
+    while (n > 0 && p[n-1] == 0) n--;
+    return n;
+}
+
+
+// The vector versions share one layout: whole vectors first, then the remaining words one by one
+// Word i of a shifted sum reads words i and i-1 of src, so the vector loops start at word 1 and load both
+#ifdef WORDS_X86
+__attribute__((target("sse2")))
+static void xor_words_sse2(pol_word_t* dst, const pol_word_t* src, uint64_t n) {
+    uint64_t i = 0;
+    for (; i+2 <= n; i += 2) {
+        __m128i* d = (__m128i*)(dst+i);
+        _mm_storeu_si128(d, _mm_xor_si128(_mm_loadu_si128(d), _mm_loadu_si128((const __m128i*)(src+i))));
+    }
+    for (; i < n; i++) dst[i] ^= src[i];
+}
+
+__attribute__((target("sse2")))
+static pol_word_t shift_xor_words_sse2(pol_word_t* dst, const pol_word_t* src, uint64_t n, uint8_t bits) {
+    if (n == 0) return 0;
+    const __m128i left = _mm_cvtsi32_si128(bits);
+    const __m128i right = _mm_cvtsi32_si128(POL_WORD_BITS-bits);
+    dst[0] ^= src[0] << bits;
+    uint64_t i = 1;
+    for (; i+2 <= n; i += 2) {
+        __m128i high = _mm_sll_epi64(_mm_loadu_si128((const __m128i*)(src+i)), left);
+        __m128i low = _mm_srl_epi64(_mm_loadu_si128((const __m128i*)(src+i-1)), right);
+        __m128i* d = (__m128i*)(dst+i);
+        _mm_storeu_si128(d, _mm_xor_si128(_mm_loadu_si128(d), _mm_or_si128(high, low)));
+    }
+    for (; i < n; i++) dst[i] ^= (src[i] << bits) | (src[i-1] >> (POL_WORD_BITS-bits));
+    return src[n-1] >> (POL_WORD_BITS-bits);
+}
+
+__attribute__((target("sse2")))
+static uint64_t used_words_sse2(const pol_word_t* p, uint64_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    for (; n >= 2; n -= 2) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p+n-2));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xFFFF) break;
+    }
+    return used_words_portable(p, n);
+}
+
+
+__attribute__((target("avx2")))
+static void xor_words_avx2(pol_word_t* dst, const pol_word_t* src, uint64_t n) {
+    uint64_t i = 0;
+    for (; i+4 <= n; i += 4) {
+        __m256i* d = (__m256i*)(dst+i);
+        _mm256_storeu_si256(d, _mm256_xor_si256(_mm256_loadu_si256(d), _mm256_loadu_si256((const __m256i*)(src+i))));
+    }
+    for (; i < n; i++) dst[i] ^= src[i];
+}
+
+__attribute__((target("avx2")))
+static pol_word_t shift_xor_words_avx2(pol_word_t* dst, const pol_word_t* src, uint64_t n, uint8_t bits) {
+    if (n == 0) return 0;
+    const __m128i left = _mm_cvtsi32_si128(bits);
+    const __m128i right = _mm_cvtsi32_si128(POL_WORD_BITS-bits);
+    dst[0] ^= src[0] << bits;
+    uint64_t i = 1;
+    for (; i+4 <= n; i += 4) {
+        __m256i high = _mm256_sll_epi64(_mm256_loadu_si256((const __m256i*)(src+i)), left);
+        __m256i low = _mm256_srl_epi64(_mm256_loadu_si256((const __m256i*)(src+i-1)), right);
+        __m256i* d = (__m256i*)(dst+i);
+        _mm256_storeu_si256(d, _mm256_xor_si256(_mm256_loadu_si256(d), _mm256_or_si256(high, low)));
+    }
+    for (; i < n; i++) dst[i] ^= (src[i] << bits) | (src[i-1] >> (POL_WORD_BITS-bits));
+    return src[n-1] >> (POL_WORD_BITS-bits);
+}
+
+__attribute__((target("avx2")))
+static uint64_t used_words_avx2(const pol_word_t* p, uint64_t n) {
+    for (; n >= 4; n -= 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p+n-4));
+        if (!_mm256_testz_si256(v, v)) break;
+    }
+    return used_words_portable(p, n);
+}
+
+
+// The last words are handled by masked loads and stores instead of one by one
+__attribute__((target("avx512f")))
+static void xor_words_avx512(pol_word_t* dst, const pol_word_t* src, uint64_t n) {
+    uint64_t i = 0;
+    for (; i+8 <= n; i += 8) {
+        __m512i d = _mm512_loadu_si512((const void*)(dst+i));
+        _mm512_storeu_si512((void*)(dst+i), _mm512_xor_si512(d, _mm512_loadu_si512((const void*)(src+i))));
+    }
+    if (i < n) {
+        __mmask8 mask = (__mmask8)((1u << (n-i)) - 1);
+        __m512i d = _mm512_maskz_loadu_epi64(mask, dst+i);
+        _mm512_mask_storeu_epi64(dst+i, mask, _mm512_xor_si512(d, _mm512_maskz_loadu_epi64(mask, src+i)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static pol_word_t shift_xor_words_avx512(pol_word_t* dst, const pol_word_t* src, uint64_t n, uint8_t bits) {
+    if (n == 0) return 0;
+    const __m128i left = _mm_cvtsi32_si128(bits);
+    const __m128i right = _mm_cvtsi32_si128(POL_WORD_BITS-bits);
+    dst[0] ^= src[0] << bits;
+    uint64_t i = 1;
+    for (; i < n; i += 8) {
+        __mmask8 mask = n-i >= 8 ? 0xFF : (__mmask8)((1u << (n-i)) - 1);
+        __m512i high = _mm512_sll_epi64(_mm512_maskz_loadu_epi64(mask, src+i), left);
+        __m512i low = _mm512_srl_epi64(_mm512_maskz_loadu_epi64(mask, src+i-1), right);
+        __m512i d = _mm512_maskz_loadu_epi64(mask, dst+i);
+        _mm512_mask_storeu_epi64(dst+i, mask, _mm512_xor_si512(d, _mm512_or_si512(high, low)));
+    }
+    return src[n-1] >> (POL_WORD_BITS-bits);
+}
+
+__attribute__((target("avx512f")))
+static uint64_t used_words_avx512(const pol_word_t* p, uint64_t n) {
+    for (; n >= 8; n -= 8) {
+        __m512i v = _mm512_loadu_si512((const void*)(p+n-8));
+        if (_mm512_test_epi64_mask(v, v)) break;
+    }
+    return used_words_portable(p, n);
+}
+#endif
+
+
+typedef struct {
+    void (*xor_words)(pol_word_t*, const pol_word_t*, uint64_t);
+    pol_word_t (*shift_xor_words)(pol_word_t*, const pol_word_t*, uint64_t, uint8_t);
+    uint64_t (*used_words)(const pol_word_t*, uint64_t);
+} WordKernels;
+
+static const WordKernels kernels[POL_ISA_AUTO] = {
+    {xor_words_portable, shift_xor_words_portable, used_words_portable},
+#ifdef WORDS_X86
+    {xor_words_sse2, shift_xor_words_sse2, used_words_sse2},
+    {xor_words_avx2, shift_xor_words_avx2, used_words_avx2},
+    {xor_words_avx512, shift_xor_words_avx512, used_words_avx512}
+#endif
+};
+
+PolIsa pol_isa_supported(void) {
+#ifdef WORDS_X86
+    if (__builtin_cpu_supports("avx512f")) return POL_ISA_AVX512;
+    if (__builtin_cpu_supports("avx2")) return POL_ISA_AVX2;
+    // x86-64 always has SSE2
+    return POL_ISA_SSE2;
+#else
+    return POL_ISA_PORTABLE;
+#endif
+}
+
+// Level in use, accessed atomically since any thread may detect it
+static PolIsa isa = POL_ISA_AUTO;
+
+void set_pol_isa(PolIsa level) {
+    PolIsa supported = pol_isa_supported();
+    if (level == POL_ISA_AUTO) level = supported;
+    if (level > supported) exit(1);
+    __atomic_store_n(&isa, level, __ATOMIC_RELAXED);
+}
+
+PolIsa get_pol_isa(void) {
+    // Threads racing to detect the level all store the same one, so relaxed accesses suffice
+    PolIsa level = __atomic_load_n(&isa, __ATOMIC_RELAXED);
+    if (level == POL_ISA_AUTO) {
+        level = pol_isa_supported();
+        __atomic_store_n(&isa, level, __ATOMIC_RELAXED);
+    }
+    return level;
+}
+
+void xor_words(pol_word_t* dst, const pol_word_t* src, uint64_t n) {
+    kernels[get_pol_isa()].xor_words(dst, src, n);
+}
+
+pol_word_t shift_xor_words(pol_word_t* dst, const pol_word_t* src, uint64_t n, uint8_t bits) {
+    return kernels[get_pol_isa()].shift_xor_words(dst, src, n, bits);
+}
+
+uint64_t used_words(const pol_word_t* p, uint64_t n) {
+    return kernels[get_pol_isa()].used_words(p, n);
+}
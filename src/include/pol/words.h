@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "polynom.h"
+
+
+/**
+ * @file words.h
+ * @brief Vectorized kernels on arrays of words.
+ *
+ * Additions, shifted additions and degree scans of polynoms are passes over their words, which SIMD instructions process several at a time.
+ * Each kernel comes in a portable version and in SSE2, AVX2 and AVX-512 versions, and the carry-less products of clmul.h follow the same choice.
+ * The instruction set is detected on the first call, and the best one the CPU supports is used, so a single binary runs everywhere.
+ *
+ * @see PolIsa
+*/
+
+
+/**
+ * @brief Instruction sets of the kernels
+ *
+ * Each level also uses the carry-less product instructions of its generation when the CPU has them:
+ * PCLMULQDQ from POL_ISA_SSE2 on, and VPCLMULQDQ on 256-bit or 512-bit vectors for POL_ISA_AVX2 and POL_ISA_AVX512.
+ * POL_ISA_AUTO stands for the best level the CPU supports.
+*/
+typedef enum {
+    POL_ISA_PORTABLE,
+    POL_ISA_SSE2,
+    POL_ISA_AVX2,
+    POL_ISA_AVX512,
+    POL_ISA_AUTO
+} PolIsa;
+
+/**
+ * @brief Get the best instruction set of the CPU
+ *
+ * @return Highest level the CPU supports, POL_ISA_PORTABLE on other architectures than x86-64.
+*/
+PolIsa pol_isa_supported(void);
+
+/**
+ * @brief Set the instruction set of the kernels
+ *
+ * The choice applies to the whole process.
+ * This function must not be called while other threads use polynoms or the kernels:
+ * a thread running an operation could mix the kernels of two levels.
+ * Lower levels are meant for testing and benchmarking.
+ * Exits if the CPU does not support the level.
+ *
+ * @param[in] isa Level to use, or POL_ISA_AUTO for the best one.
+*/
+void set_pol_isa(PolIsa isa);
+
+/**
+ * @brief Get the instruction set of the kernels
+ *
+ * @return Level in use, never POL_ISA_AUTO.
+*/
+PolIsa get_pol_isa(void);
+
+/**
+ * @brief Add a word array into another
+ *
+ * This function computes dst ^= src on n words.
+ * dst and src must not overlap.
+ *
+ * @param[in,out] dst Words of the accumulator.
+ * @param[in] src Words to add.
+ * @param[in] n Number of words.
+*/
+void xor_words(pol_word_t* dst, const pol_word_t* src, uint64_t n);
+
+/**
+ * @brief Add a shifted word array into another
+ *
+ * This function computes dst ^= src * X^bits on the n words of dst facing the ones of src, and returns the bits of src shifted past them.
+ * dst and src must not overlap.
+ *
+ * @param[in,out] dst Words of the accumulator.
+ * @param[in] src Words to add.
+ * @param[in] n Number of words.
+ * @param[in] bits Shift, with 0 < bits < POL_WORD_BITS.
+ * @return The top bits of src, to add into word n of dst.
+*/
+pol_word_t shift_xor_words(pol_word_t* dst, const pol_word_t* src, uint64_t n, uint8_t bits);
+
+/**
+ * @brief Find the last non-null word
+ *
+ * @param[in] p Words to scan.
+ * @param[in] n Number of words.
+ * @return Number of words up to the last non-null one included, 0 if they are all null.
+*/
+uint64_t used_words(const pol_word_t* p, uint64_t n);
@@ -0,0 +1,260 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "utils.h"
+#include "polynom.h"
+#include "pool.h"
+#include "random.h"
+#include "homomorph.h"
+
+
+/*
+ * Times the polynomial primitives and the homomorphic operations over a sweep of degrees and public key sizes.
+ *
+ * Usage: benchmark [--json] [--repetitions n] [output]
+ * Each line gives the median, minimum and standard deviation of the time per operation over the repetitions,
+ * the words buffers allocated per operation, those of them the pool had to get from the system, and the throughput.
+ * The results are written as CSV, or JSON with --json, on the standard output or in output, and the progress on the standard error.
+ * The random stream is seeded with a constant, so two runs time the same operands and can be compared.
+*/
+
+
+#define REPETITIONS 7
+#define MIN_DURATION 0.02
+
+static const pol_degree_t degrees[] = {256, 1024, 4096, 16384, 65536};
+// Secret key and random element degrees, the noise being half of them
+static const pol_degree_t key_degrees[] = {256, 1024, 2048};
+static const uint64_t taus[] = {64, 256};
+#define ADD_WIDTH 16
+
+
+// Monotonic, so that a change of the wall clock does not skew a measure
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// Every buffer of a polynom goes through this allocator, which counts them for the pool
+static uint64_t allocations = 0;
+
+static pol_word_t* counting_allocate(uint64_t n_words, uint64_t* capacity) {
+    allocations++;
+    return pol_pool_allocator.allocate(n_words, capacity);
+}
+
+static void counting_release(pol_word_t* words, uint64_t capacity) {
+    pol_pool_allocator.release(words, capacity);
+}
+
+
+typedef struct {
+    double median;
+    double min;
+    double stddev;
+    double allocations;
+    double system_allocations;
+    uint64_t iterations;
+} Measure;
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Times of repetitions batches of run, each one long enough to be measured, in nanoseconds per call
+static Measure measure(void (*run)(void*), void* arg, uint8_t repetitions) {
+    // The first call fills the pool and the caches
+    run(arg);
+    uint64_t iterations = 1;
+    for (;;) {
+        double start = now();
+        for (uint64_t i = 0; i < iterations; i++) run(arg);
+        if (now() - start >= MIN_DURATION) break;
+        iterations *= 2;
+    }
+
+    double times[255];
+    uint64_t first_allocations = allocations;
+    uint64_t first_system = pol_pool_stats().system_allocations;
+    for (uint8_t rep = 0; rep < repetitions; rep++) {
+        double start = now();
+        for (uint64_t i = 0; i < iterations; i++) run(arg);
+        times[rep] = (now() - start) / iterations * 1e9;
+    }
+    uint64_t calls = iterations*repetitions;
+
+    Measure m = {0};
+    m.iterations = iterations;
+    m.allocations = (double)(allocations - first_allocations) / calls;
+    m.system_allocations = (double)(pol_pool_stats().system_allocations - first_system) / calls;
+    double mean = 0;
+    for (uint8_t rep = 0; rep < repetitions; rep++) mean += times[rep] / repetitions;
+    for (uint8_t rep = 0; rep < repetitions; rep++) m.stddev += (times[rep] - mean)*(times[rep] - mean) / repetitions;
+    m.stddev = sqrt(m.stddev);
+    qsort(times, repetitions, sizeof(double), compare_doubles);
+    m.min = times[0];
+    m.median = repetitions % 2 ? times[repetitions/2] : (times[repetitions/2 - 1] + times[repetitions/2]) / 2;
+    return m;
+}
+
+
+typedef struct {
+    FILE* out;
+    bool json;
+    uint64_t rows;
+    uint8_t repetitions;
+} Report;
+
+static void report_start(Report* r) {
+    if (r->json) fprintf(r->out, "[\n");
+    else fprintf(r->out, "operation,degree,tau,repetitions,iterations,ns_median,ns_min,ns_stddev,allocations_per_op,system_allocations_per_op,ops_per_s\n");
+}
+
+static void report_end(Report* r) {
+    if (r->json) fprintf(r->out, "\n]\n");
+}
+
+// tau is 0 for the polynomial primitives
+static void report(Report* r, const char* operation, pol_degree_t degree, uint64_t tau, Measure m) {
+    fprintf(stderr, "%-16s degree %6lu tau %4lu: %12.0f ns/op, %6.2f allocations/op\n", operation, (unsigned long)degree, (unsigned long)tau, m.median, m.allocations);
+    if (r->json) {
+        fprintf(r->out, "%s  {\"operation\": \"%s\", \"degree\": %lu, \"tau\": %lu, \"repetitions\": %u, \"iterations\": %lu, ", r->rows ? ",\n" : "", operation, (unsigned long)degree, (unsigned long)tau, r->repetitions, (unsigned long)m.iterations);
+        fprintf(r->out, "\"ns_median\": %.1f, \"ns_min\": %.1f, \"ns_stddev\": %.1f, \"allocations_per_op\": %.3f, \"system_allocations_per_op\": %.3f, \"ops_per_s\": %.1f}", m.median, m.min, m.stddev, m.allocations, m.system_allocations, 1e9/m.median);
+    }
+    else {
+        fprintf(r->out, "%s,%lu,%lu,%u,%lu,", operation, (unsigned long)degree, (unsigned long)tau, r->repetitions, (unsigned long)m.iterations);
+        fprintf(r->out, "%.1f,%.1f,%.1f,%.3f,%.3f,%.1f\n", m.median, m.min, m.stddev, m.allocations, m.system_allocations, 1e9/m.median);
+    }
+    r->rows++;
+}
+
+
+typedef struct {
+    Polynomial_t a;
+    Polynomial_t b;
+} PolynomArgs;
+
+static void run_multiply(void* arg) {
+    PolynomArgs* args = (PolynomArgs*) arg;
+    Polynomial_t p = {0};
+    multiply_polynoms(args->a, args->b, &p);
+    delete_polynom(p);
+}
+
+static void run_divide(void* arg) {
+    PolynomArgs* args = (PolynomArgs*) arg;
+    Polynomial_t p = {0};
+    divide_polynoms(args->a, args->b, &p);
+    delete_polynom(p);
+}
+
+static void run_add(void* arg) {
+    PolynomArgs* args = (PolynomArgs*) arg;
+    Polynomial_t p = {0};
+    add_polynoms(args->a, args->b, &p);
+    delete_polynom(p);
+}
+
+typedef struct {
+    pol_degree_t d;
+    uint64_t tau;
+    HomomContext ctx;
+    Part part;
+    Polynomial_t c;
+    CipheredInt x;
+    CipheredInt y;
+} HomomArgs;
+
+static void run_init(void* arg) {
+    HomomArgs* args = (HomomArgs*) arg;
+    HomomContext ctx;
+    homomorph_init(args->d, args->d, args->d/2, args->tau, &ctx);
+    homomorph_clear(ctx);
+}
+
+static void run_encrypt_bit(void* arg) {
+    HomomArgs* args = (HomomArgs*) arg;
+    Polynomial_t c = {0};
+    encrypt_bit(1, args->ctx.pk, args->part, &c);
+    delete_polynom(c);
+}
+
+static void run_decrypt_bit(void* arg) {
+    HomomArgs* args = (HomomArgs*) arg;
+    bool bit;
+    decrypt_bit(args->c, args->ctx.sk, &bit);
+}
+
+static void run_ciphered_add(void* arg) {
+    HomomArgs* args = (HomomArgs*) arg;
+    CipheredInt s;
+    ciphered_add(args->x, args->y, &s);
+    delete_ciphered_int(s);
+}
+
+
+int main(int argc, char** argv) {
+    Report r = {stdout, false, 0, REPETITIONS};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) r.json = true;
+        else if (strcmp(argv[i], "--repetitions") == 0 && i+1 < argc) {
+            int n = atoi(argv[++i]);
+            if (n < 1 || n > 255) return 1;
+            r.repetitions = (uint8_t)n;
+        }
+        else {
+            r.out = fopen(argv[i], "w");
+            if (r.out == NULL) return 1;
+        }
+    }
+
+    set_pol_allocator((PolAllocator){counting_allocate, counting_release});
+    uint8_t seed[32] = {0};
+    pol_random_seed(seed);
+    srand(0);
+    report_start(&r);
+
+    for (size_t i = 0; i < sizeof(degrees)/sizeof(degrees[0]); i++) {
+        pol_degree_t n = degrees[i];
+        PolynomArgs args = {random_polynom(n), random_polynom(n)};
+        report(&r, "add_polynoms", n, 0, measure(run_add, &args, r.repetitions));
+        report(&r, "multiply_polynoms", n, 0, measure(run_multiply, &args, r.repetitions));
+        delete_polynom(args.a);
+        // A quotient of degree n, as when decrypting
+        args.a = random_polynom(2*n);
+        report(&r, "divide_polynoms", n, 0, measure(run_divide, &args, r.repetitions));
+        delete_polynom(args.a);
+        delete_polynom(args.b);
+    }
+
+    for (size_t i = 0; i < sizeof(key_degrees)/sizeof(key_degrees[0]); i++) {
+        for (size_t j = 0; j < sizeof(taus)/sizeof(taus[0]); j++) {
+            HomomArgs args = {.d = key_degrees[i], .tau = taus[j]};
+            report(&r, "homomorph_init", args.d, args.tau, measure(run_init, &args, r.repetitions));
+
+            homomorph_init(args.d, args.d, args.d/2, args.tau, &args.ctx);
+            args.part = random_part(args.tau);
+            report(&r, "encrypt_bit", args.d, args.tau, measure(run_encrypt_bit, &args, r.repetitions));
+            encrypt_bit(1, args.ctx.pk, args.part, &args.c);
+            report(&r, "decrypt_bit", args.d, args.tau, measure(run_decrypt_bit, &args, r.repetitions));
+            encrypt(rand() & 0xFFFF, ADD_WIDTH, args.ctx.pk, &args.x);
+            encrypt(rand() & 0xFFFF, ADD_WIDTH, args.ctx.pk, &args.y);
+            report(&r, "ciphered_add", args.d, args.tau, measure(run_ciphered_add, &args, r.repetitions));
+
+            delete_ciphered_int(args.x);
+            delete_ciphered_int(args.y);
+            delete_polynom(args.c);
+            delete_part(args.part);
+            homomorph_clear(args.ctx);
+        }
+    }
+
+    report_end(&r);
+    if (r.out != stdout) fclose(r.out);
+    return 0;
+}
@@ -1,11 +1,51 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h> // srand
 #include <assert.h>
+#include <unistd.h> // close
+#include <fcntl.h> // open
+#include <sys/wait.h> // waitpid
 
 #include "utils.h"
 #include "polynom.h"
+#include "clmul.h"
+#include "mul.h"
+#include "pool.h"
+#include "random.h"
+#include "sparse.h"
+#include "words.h"
 #include "homomorph.h"
+#include "circuit.h"
+#include "storage.h"
+#include "stream.h"
+#include "service.h"
+
+
+// Producer of the service test: encrypts batches through the service and checks them
+typedef struct {
+    EncryptService* service;
+    SecKey sk;
+    uint64_t seed;
+} ServiceProducer;
+
+static void* service_producer(void* arg) {
+    ServiceProducer* p = (ServiceProducer*) arg;
+    for (uint8_t round = 0; round < 8; round++) {
+        uint64_t n[4];
+        CipheredInt c[4];
+        for (uint8_t k = 0; k < 4; k++) n[k] = (p->seed * (4*round + k + 1)) & 0xFFFF;
+        encrypt_service_encrypt(p->service, n, 4, 16, c);
+        for (uint8_t k = 0; k < 4; k++) {
+            uint64_t m;
+            decrypt(&c[k], p->sk, &m);
+            assert(m == n[k]);
+            delete_ciphered_int(c[k]);
+        }
+    }
+    pol_pool_trim();
+    return NULL;
+}
 
 
 int main(int argc, char** argv) {
@@ -34,6 +74,63 @@ int main(int argc, char** argv) {
 
     printf("Part test passed\n");
 
+    /* --- Test Random ---*/
+    printf("Random test\n");
+    // RFC 8439, section 2.3.2
+    uint8_t key[32], nonce[12] = {0, 0, 0, 0x09, 0, 0, 0, 0x4a, 0, 0, 0, 0}, block[64];
+    for (uint8_t i = 0; i < 32; i++) key[i] = i;
+    const uint8_t expected_block[64] = {
+        0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+        0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+        0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+        0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e
+    };
+    chacha20_block(key, 1, nonce, block);
+    for (uint8_t i = 0; i < 64; i++) assert(block[i] == expected_block[i]);
+    printf(" > chacha20_block test passed\n");
+
+    // A seeded stream is replayed, whatever the sizes of the requests
+    uint8_t stream1[300], stream2[300];
+    pol_random_seed(key);
+    pol_random_fill(stream1, sizeof(stream1));
+    pol_random_seed(key);
+    for (uint16_t i = 0, n = 1; i < sizeof(stream2); i += n, n = n*2 + 1) {
+        pol_random_fill(stream2 + i, MIN(n, sizeof(stream2) - i));
+    }
+    for (uint16_t i = 0; i < sizeof(stream1); i++) assert(stream1[i] == stream2[i]);
+    // The child of a fork does not replay the stream of its parent
+    int fds[2];
+    assert(pipe(fds) == 0);
+    pol_random_seed(key);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        pol_random_fill(stream2, sizeof(stream2));
+        _exit(write(fds[1], stream2, sizeof(stream2)) == sizeof(stream2) ? 0 : 1);
+    }
+    pol_random_fill(stream1, sizeof(stream1));
+    int status;
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(read(fds[0], stream2, sizeof(stream2)) == sizeof(stream2));
+    assert(memcmp(stream1, stream2, sizeof(stream1)) != 0);
+    close(fds[0]);
+    close(fds[1]);
+    // Back to an unpredictable stream for the other tests
+    pol_random_system.fill(key, sizeof(key));
+    pol_random_seed(key);
+    printf(" > pol_random_seed test passed\n");
+
+    // Coefficients above the degree stay null
+    for (pol_degree_t degree = 0; degree < 3*POL_WORD_BITS; degree += 7) {
+        Polynomial_t rp = random_polynom(degree);
+        assert(get_coefficient(rp, degree) == 1);
+        for (pol_degree_t i = degree+1; i < rp.size; i++) assert(get_coefficient(rp, i) == 0);
+        delete_polynom(rp);
+    }
+    printf(" > random_polynom test passed\n");
+
+    printf("Random test passed\n");
+
     /* --- Test Polynomial ---*/
     printf("Polynomial test\n");
     Polynomial_t p, p1, p2, p3;
@@ -66,7 +163,7 @@ int main(int argc, char** argv) {
     assert(p1.degree == p2.degree);
     assert(p1.coefficients != p2.coefficients);
     for (pol_degree_t i = 0; i <= p1.degree; i++) {
-        assert(p1.coefficients[i] == p2.coefficients[i]);
+        assert(get_coefficient(p1, i) == get_coefficient(p2, i));
     }
     delete_polynom(p1);
     delete_polynom(p2);
@@ -80,7 +177,7 @@ int main(int argc, char** argv) {
     assert(p3.degree == 0);
     assert(p3.coefficients != NULL);
     for (pol_degree_t i = 0; i <= p3.degree; i++) {
-        assert(p3.coefficients[i] == 0);
+        assert(get_coefficient(p3, i) == 0);
     }
     delete_polynom(p1);
     delete_polynom(p2);
@@ -95,30 +192,117 @@ int main(int argc, char** argv) {
     assert(p3.degree == 2*d+1);
     assert(p3.coefficients != NULL);
     for (pol_degree_t i = 0; i < 2*d+1; i++) {
-        assert(p3.coefficients[i] == 0);
+        assert(get_coefficient(p3, i) == 0);
     }
-    assert(p3.coefficients[2*d+1] == 1);
+    assert(get_coefficient(p3, 2*d+1) == 1);
     delete_polynom(p1);
     delete_polynom(p2);
     delete_polynom(p3);
-    p1.degree = 1;
-    p1.coefficients = (bool*) malloc(2*sizeof(bool));
-    p1.coefficients[0] = 1;
-    p1.coefficients[1] = 1;
-    p2.degree = 1;
-    p2.coefficients = (bool*) malloc(2*sizeof(bool));
-    p2.coefficients[0] = 1;
-    p2.coefficients[1] = 1;
+    p1 = monom(1);
+    set_coefficient(&p1, 0, 1);
+    p2 = monom(1);
+    set_coefficient(&p2, 0, 1);
     multiply_polynoms(p1, p2, &p1);
     assert(p1.degree == 2);
     assert(p1.coefficients != NULL);
-    assert(p1.coefficients[0] == 1);
-    assert(p1.coefficients[1] == 0);
-    assert(p1.coefficients[2] == 1);
+    assert(get_coefficient(p1, 0) == 1);
+    assert(get_coefficient(p1, 1) == 0);
+    assert(get_coefficient(p1, 2) == 1);
     delete_polynom(p1);
     delete_polynom(p2);
+    p1 = random_polynom(3*d+17);
+    p2 = random_polynom(d+5);
+    multiply_polynoms(p1, p2, &p3);
+    assert(p3.degree == p1.degree + p2.degree);
+    for (pol_degree_t k = 0; k <= p3.degree; k++) {
+        bool coefficient = 0;
+        for (pol_degree_t i = (k > p2.degree ? k - p2.degree : 0); i <= k && i <= p1.degree; i++) {
+            coefficient ^= get_coefficient(p1, i) & get_coefficient(p2, k-i);
+        }
+        assert(get_coefficient(p3, k) == coefficient);
+    }
+    delete_polynom(p1);
+    delete_polynom(p2);
+    delete_polynom(p3);
     printf(" > multiply_polynoms test passed\n");
 
+    // Test clmul_word
+    for (uint16_t t = 0; t < nb_test; t++) {
+        pol_word_t a = ((pol_word_t)rand() << 42) ^ ((pol_word_t)rand() << 21) ^ (pol_word_t)rand();
+        pol_word_t b = ((pol_word_t)rand() << 43) ^ ((pol_word_t)rand() << 22) ^ (pol_word_t)rand();
+        pol_word_t lo = 0, hi = 0, expected_lo = 0, expected_hi = 0;
+        clmul_word(a, b, &lo, &hi);
+        for (uint8_t i = 0; i < POL_WORD_BITS; i++) {
+            if ((a >> i) & 1) {
+                expected_lo ^= b << i;
+                if (i) expected_hi ^= b >> (POL_WORD_BITS-i);
+            }
+        }
+        assert(lo == expected_lo);
+        assert(hi == expected_hi);
+    }
+    printf(" > clmul_word test passed\n");
+
+    // Test the kernels of each instruction set against the portable ones, on all the lengths around their vector sizes
+    {
+        pol_word_t src[40], dst[41], expected[41], product[80], expected_product[80];
+        for (uint8_t isa = POL_ISA_SSE2; isa <= pol_isa_supported(); isa++) {
+            for (uint8_t n = 0; n < 40; n++) {
+                for (uint8_t i = 0; i < 41; i++) {
+                    src[i % 40] = ((pol_word_t)rand() << 42) ^ ((pol_word_t)rand() << 21) ^ (pol_word_t)rand();
+                    dst[i] = expected[i] = ((pol_word_t)rand() << 42) ^ ((pol_word_t)rand() << 21) ^ (pol_word_t)rand();
+                }
+                uint8_t bits = 1 + rand() % (POL_WORD_BITS-1);
+                set_pol_isa(POL_ISA_PORTABLE);
+                xor_words(expected, src, n);
+                pol_word_t expected_carry = shift_xor_words(expected, src, n, bits);
+                uint64_t expected_used = used_words(src, n);
+                memset(expected_product, 0, sizeof(expected_product));
+                clmul_words(src, n/2 + 1, src + 20, n/2, expected_product);
+                set_pol_isa((PolIsa)isa);
+                xor_words(dst, src, n);
+                assert(shift_xor_words(dst, src, n, bits) == expected_carry);
+                for (uint8_t i = 0; i < 41; i++) assert(dst[i] == expected[i]);
+                assert(used_words(src, n) == expected_used);
+                memset(product, 0, sizeof(product));
+                clmul_words(src, n/2 + 1, src + 20, n/2, product);
+                for (uint8_t i = 0; i < 80; i++) assert(product[i] == expected_product[i]);
+                // Null top words
+                for (uint8_t i = n/2; i < n; i++) src[i] = 0;
+                assert(used_words(src, n) == used_words(src, n/2));
+            }
+        }
+        set_pol_isa(POL_ISA_AUTO);
+        assert(get_pol_isa() == pol_isa_supported());
+    }
+    printf(" > instruction set test passed\n");
+
+    // Test Karatsuba, Toom-3 and additive FFT
+    const MulThresholds default_thresholds = get_mul_thresholds();
+    const pol_degree_t degrees[][2] = {{40*d, 40*d}, {40*d+100, 27*d+3}, {40*d, 13*d+1}, {5*d, 9}};
+    for (uint8_t t = 0; t < sizeof(degrees)/sizeof(degrees[0]); t++) {
+        p1 = random_polynom(degrees[t][0]);
+        p2 = random_polynom(degrees[t][1]);
+        set_mul_thresholds((MulThresholds){UINT64_MAX, UINT64_MAX, UINT64_MAX});
+        multiply_polynoms(p1, p2, &p3);
+        const MulThresholds test_thresholds[] = {{2, 6, UINT64_MAX}, {UINT64_MAX, UINT64_MAX, 1}};
+        for (uint8_t k = 0; k < sizeof(test_thresholds)/sizeof(test_thresholds[0]); k++) {
+            Polynomial_t p4 = {0};
+            set_mul_thresholds(test_thresholds[k]);
+            multiply_polynoms(p1, p2, &p4);
+            assert(p3.degree == p4.degree);
+            for (pol_degree_t i = 0; i < POL_WORDS(p3.degree + 1); i++) {
+                assert(p3.coefficients[i] == p4.coefficients[i]);
+            }
+            delete_polynom(p4);
+        }
+        delete_polynom(p1);
+        delete_polynom(p2);
+        delete_polynom(p3);
+    }
+    set_mul_thresholds(default_thresholds);
+    printf(" > mul_words test passed\n");
+
     // Test divide_polynoms
     p1 = monom(d+1);
     p2 = monom(d);
@@ -126,31 +310,186 @@ int main(int argc, char** argv) {
     divide_polynoms(p1, p2, &p3);
     assert(p3.degree == 1);
     assert(p3.coefficients != NULL);
-    assert(p3.coefficients[0] == 0);
-    assert(p3.coefficients[1] == 1);
+    assert(get_coefficient(p3, 0) == 0);
+    assert(get_coefficient(p3, 1) == 1);
     delete_polynom(p1);
     delete_polynom(p2);
     delete_polynom(p3);
-    p1.degree = 2;
-    p1.coefficients = (bool*) malloc(3*sizeof(bool));
-    p1.coefficients[0] = 1;
-    p1.coefficients[1] = 0;
-    p1.coefficients[2] = 1;
-    p2.degree = 1;
-    p2.coefficients = (bool*) malloc(2*sizeof(bool));
-    p2.coefficients[0] = 1;
-    p2.coefficients[1] = 1;
+    p1 = monom(2);
+    set_coefficient(&p1, 0, 1);
+    p2 = monom(1);
+    set_coefficient(&p2, 0, 1);
     divide_polynoms(p1, p2, &p1);
     assert(p1.degree == 1);
     assert(p1.coefficients != NULL);
-    assert(p1.coefficients[0] == 1);
-    assert(p1.coefficients[1] == 1);
+    assert(get_coefficient(p1, 0) == 1);
+    assert(get_coefficient(p1, 1) == 1);
+    delete_polynom(p1);
+    delete_polynom(p2);
+    p1 = random_polynom(5*d+3);
+    p2 = random_polynom(d);
+    divide_polynoms(p1, p2, &p3);
+    Polynomial_t r = {0};
+    modulo_polynoms(p1, p2, &r);
+    assert(p3.degree == p1.degree - p2.degree);
+    assert(r.degree < p2.degree);
+    Polynomial_t qd = {0};
+    multiply_polynoms(p3, p2, &qd);
+    add_polynoms(qd, r, &p);
+    assert(p.degree == p1.degree);
+    for (pol_degree_t i = 0; i <= p1.degree; i++) {
+        assert(get_coefficient(p, i) == get_coefficient(p1, i));
+    }
+    delete_polynom(p);
+    delete_polynom(qd);
+    delete_polynom(r);
     delete_polynom(p1);
     delete_polynom(p2);
+    delete_polynom(p3);
     printf(" > divide_polynoms test passed\n");
 
+    // Test xor_into, mul_add_into and shift_xor_into
+    p1 = random_polynom(3*d+7);
+    p2 = random_polynom(d+40);
+    Polynomial_t acc = {0};
+    xor_into(&acc, p2);
+    mul_add_into(&acc, p1, p2);
+    shift_xor_into(&acc, p2, 2*d+5);
+    multiply_polynoms(p1, p2, &p3);
+    add_polynoms(p3, p2, &p);
+    delete_polynom(p3);
+    p3 = monom(2*d+5);
+    multiply_polynoms(p3, p2, &qd);
+    delete_polynom(p3);
+    add_polynoms(p, qd, &p3);
+    assert(acc.degree == p3.degree);
+    for (pol_degree_t i = 0; i < POL_WORDS(p3.degree + 1); i++) {
+        assert(acc.coefficients[i] == p3.coefficients[i]);
+    }
+    // Accumulating into a factor or into itself
+    mul_add_into(&acc, acc, p2);
+    shift_xor_into(&acc, acc, 0);
+    assert(acc.degree == 0 && acc.coefficients[0] == 0);
+    xor_into(&acc, p1);
+    xor_into(&acc, acc);
+    assert(acc.degree == 0 && acc.coefficients[0] == 0);
+    delete_polynom(acc);
+    delete_polynom(qd);
+    delete_polynom(p);
+    delete_polynom(p1);
+    delete_polynom(p2);
+    delete_polynom(p3);
+    printf(" > accumulate test passed\n");
+
+    // Test lazy_xor_into, normalize_polynom and reserve_polynom
+    acc = (Polynomial_t){0};
+    reserve_polynom(&acc, 2*d);
+    assert(acc.degree == 0 && acc.coefficients[0] == 0 && acc.size >= 2*d + 1);
+    pol_word_t* buffer = acc.coefficients;
+    p1 = random_polynom(2*d);
+    p2 = random_polynom(2*d);
+    set_coefficient(&p2, 3, !get_coefficient(p1, 3));
+    lazy_xor_into(&acc, p1);
+    lazy_xor_into(&acc, p2);
+    // The leading coefficients cancel, and the degree is left as it was
+    assert(acc.degree == 2*d && acc.coefficients == buffer);
+    normalize_polynom(&acc);
+    add_polynoms(p1, p2, &p3);
+    assert(acc.degree == p3.degree && acc.degree >= 3);
+    for (pol_degree_t i = 0; i < POL_WORDS(p3.degree + 1); i++) assert(acc.coefficients[i] == p3.coefficients[i]);
+    lazy_xor_into(&acc, acc);
+    normalize_polynom(&acc);
+    assert(acc.degree == 0 && acc.coefficients[0] == 0);
+    delete_polynom(acc);
+    delete_polynom(p1);
+    delete_polynom(p2);
+    delete_polynom(p3);
+    printf(" > lazy accumulate test passed\n");
+
+    // Test sparse polynoms
+    p1 = random_polynom(d+9);
+    SparsePolynomial_t sp = sparse_polynom(p1);
+    p2 = dense_polynom(sp);
+    assert(p2.degree == p1.degree);
+    for (pol_degree_t i = 0; i < POL_WORDS(p1.degree + 1); i++) assert(p1.coefficients[i] == p2.coefficients[i]);
+    sparse_xor_into(&p2, sp);
+    assert(p2.degree == 0 && p2.coefficients[0] == 0);
+    delete_sparse_polynom(sp);
+    delete_polynom(p1);
+    delete_polynom(p2);
+    // A sparse factor of the size of the other goes through shifts, and gives the same product as the kernels
+    p1 = monom(40*d);
+    set_coefficient(&p1, 77, 1);
+    set_coefficient(&p1, 0, 1);
+    p2 = random_polynom(40*d+5);
+    multiply_polynoms(p2, p1, &p3);
+    uint64_t n1 = POL_WORDS(p1.degree + 1), n2 = POL_WORDS(p2.degree + 1);
+    pol_word_t* expected_words = (pol_word_t*) calloc(n1 + n2, sizeof(pol_word_t));
+    assert(expected_words != NULL);
+    mul_words(p1.coefficients, n1, p2.coefficients, n2, expected_words);
+    assert(p3.degree == p1.degree + p2.degree);
+    for (pol_degree_t i = 0; i < POL_WORDS(p3.degree + 1); i++) assert(p3.coefficients[i] == expected_words[i]);
+    free(expected_words);
+    delete_polynom(p1);
+    delete_polynom(p2);
+    delete_polynom(p3);
+    // Product by the null polynom
+    p1 = constant_polynom(false);
+    p2 = random_polynom(d);
+    multiply_polynoms(p1, p2, &p3);
+    assert(p3.degree == 0 && p3.coefficients[0] == 0);
+    delete_polynom(p1);
+    delete_polynom(p2);
+    delete_polynom(p3);
+    printf(" > sparse test passed\n");
+
     printf("Polynomial test passed\n");
 
+    /* --- Test Pool ---*/
+    printf("Pool test\n");
+    PolPoolStats stats;
+    p1 = random_polynom(4*d);
+    p2 = random_polynom(3*d);
+    for (uint8_t t = 0; t < 3; t++) {
+        // Second and third runs must be served by the free lists only
+        if (t == 2) assert(pol_pool_stats().system_allocations == stats.system_allocations);
+        stats = pol_pool_stats();
+        Polynomial_t sum = {0}, prod = {0}, res = {0};
+        add_polynoms(p1, p2, &sum);
+        multiply_polynoms(sum, p2, &prod);
+        add_polynoms(sum, prod, &res);
+        delete_polynom(sum);
+        delete_polynom(prod);
+        divide_polynoms(res, p1, &sum);
+        modulo_polynoms(res, p2, &prod);
+        delete_polynom(res);
+        delete_polynom(sum);
+        delete_polynom(prod);
+    }
+    delete_polynom(p1);
+    delete_polynom(p2);
+    pol_pool_trim();
+    assert(pol_pool_stats().cached_words == 0);
+    printf(" > steady state test passed\n");
+
+    // Buffers of any size go back and forth through the pool
+    for (uint64_t n = 1; n < 5000; n += n/3 + 1) {
+        uint64_t capacity;
+        pol_word_t* words = pol_allocate(n, &capacity);
+        assert(capacity >= n && capacity <= n + n/4 + 1);
+        for (uint64_t i = 0; i < capacity; i++) assert(words[i] == 0);
+        words[capacity-1] = 1;
+        pol_release(words, capacity);
+        pol_word_t* again = pol_allocate(n, &capacity);
+        assert(again == words);
+        assert(again[capacity-1] == 0);
+        pol_release(again, capacity);
+    }
+    pol_pool_trim();
+    printf(" > size classes test passed\n");
+
+    printf("Pool test passed\n");
+
 
     /* --- Test Homomorph ---*/
     printf("Homomorph test\n");
@@ -169,7 +508,7 @@ int main(int argc, char** argv) {
 
         decrypt_bit(c, ctx.sk, &y);
 
-        // assert(x == y);
+        assert(x == y);
         printf(" > Test %d/%d passed\n", i, nb_test);
 
         delete_part(part);
@@ -177,7 +516,558 @@ int main(int argc, char** argv) {
         homomorph_clear(ctx);
     }
 
+
+    // Keys depend on the seed only, not on the number of threads
+    uint8_t seed[32];
+    pol_random_fill(seed, sizeof(seed));
+    HomomContext ctx_threads = {0};
+    pol_random_seed(seed);
+    homomorph_init(d, dp, delta, tau, &ctx);
+    pol_random_seed(seed);
+    homomorph_init_threads(d, dp, delta, tau, 3, &ctx_threads);
+    assert(ctx.sk.degree == ctx_threads.sk.degree);
+    for (pol_degree_t i = 0; i < POL_WORDS(ctx.sk.degree + 1); i++) {
+        assert(ctx.sk.coefficients[i] == ctx_threads.sk.coefficients[i]);
+    }
+    for (uint64_t k = 0; k < tau; k++) {
+        assert(ctx.pk.elements[k].degree == ctx_threads.pk.elements[k].degree);
+        for (pol_degree_t i = 0; i < POL_WORDS(ctx.pk.elements[k].degree + 1); i++) {
+            assert(ctx.pk.elements[k].coefficients[i] == ctx_threads.pk.elements[k].coefficients[i]);
+        }
+    }
+    part = random_part(tau);
+    x = rand() % 2;
+    encrypt_bit(x, ctx_threads.pk, part, &c);
+    decrypt_bit(c, ctx_threads.sk, &y);
+    assert(x == y);
+    delete_part(part);
+    delete_polynom(c);
+    homomorph_clear(ctx);
+    homomorph_clear(ctx_threads);
+    printf(" > homomorph_init_threads test passed\n");
+
     printf("Homomorph test passed\n");
 
+    /* --- Test EncryptTable ---*/
+    printf("EncryptTable test\n");
+    homomorph_init(d, dp, delta, tau, &ctx);
+    // Windows of 1, of a size that does not divide tau, and of the default budget
+    const uint64_t budgets[] = {1, 400000, 0};
+    for (uint8_t t = 0; t < sizeof(budgets)/sizeof(budgets[0]); t++) {
+        EncryptTable table;
+        encrypt_table_init(ctx.pk, budgets[t], &table);
+        assert(budgets[t] != 1 || table.window == 1);
+        assert(table.n_windows * table.window >= tau);
+        for (uint16_t i = 0; i < 10; i++) {
+            part = random_part(tau);
+            x = rand() % 2;
+            Polynomial_t expected = {0};
+            encrypt_bit(x, ctx.pk, part, &expected);
+            encrypt_bit_table(x, table, part, &c);
+            assert(c.degree == expected.degree);
+            for (pol_degree_t k = 0; k < POL_WORDS(c.degree + 1); k++) {
+                assert(c.coefficients[k] == expected.coefficients[k]);
+            }
+            decrypt_bit(c, ctx.sk, &y);
+            assert(x == y);
+            delete_polynom(expected);
+            delete_polynom(c);
+            delete_part(part);
+        }
+        encrypt_table_clear(table);
+    }
+    homomorph_clear(ctx);
+    printf("EncryptTable test passed\n");
+
+    /* --- Test encrypt_bits ---*/
+    printf("encrypt_bits test\n");
+    homomorph_init(d, dp, delta, tau, &ctx);
+    // More bits than a group, so that the public key goes through several passes
+    const uint64_t nb_bits = 2*ENCRYPT_BATCH_BYTES / (POL_WORDS(d + dp + 1)*sizeof(pol_word_t)) + 3;
+    bool* bits = (bool*) malloc(nb_bits*sizeof(bool));
+    bool* bits_decrypted = (bool*) malloc(nb_bits*sizeof(bool));
+    Polynomial_t* bit_ciphers = (Polynomial_t*) malloc(nb_bits*sizeof(Polynomial_t));
+    assert(bits != NULL && bits_decrypted != NULL && bit_ciphers != NULL);
+    for (uint64_t i = 0; i < nb_bits; i++) bits[i] = rand() % 2;
+    encrypt_bits(bits, nb_bits, ctx.pk, bit_ciphers);
+    DecryptContext batch_dctx;
+    decrypt_context_init(ctx.sk, d + dp, &batch_dctx);
+    decrypt_bits(bit_ciphers, nb_bits, batch_dctx, bits_decrypted);
+    decrypt_context_clear(batch_dctx);
+    for (uint64_t i = 0; i < nb_bits; i++) {
+        assert(bits_decrypted[i] == bits[i]);
+        delete_polynom(bit_ciphers[i]);
+    }
+    free(bits);
+    free(bits_decrypted);
+    free(bit_ciphers);
+    printf(" > encrypt_bits test passed\n");
+
+    uint64_t values[3] = {0, UINT64_MAX, ((uint64_t)rand() << 33) ^ (uint64_t)rand()};
+    CipheredInt ciphered_values[3];
+    encrypt_many(values, 3, 64, ctx.pk, ciphered_values);
+    for (uint8_t k = 0; k < 3; k++) {
+        uint64_t value;
+        assert(ciphered_values[k].width == 64);
+        decrypt(&ciphered_values[k], ctx.sk, &value);
+        assert(value == values[k]);
+        delete_ciphered_int(ciphered_values[k]);
+    }
+    // Integers of no bits
+    encrypt_many(values, 3, 0, ctx.pk, ciphered_values);
+    for (uint8_t k = 0; k < 3; k++) {
+        uint64_t value;
+        assert(ciphered_values[k].width == 0);
+        decrypt(&ciphered_values[k], ctx.sk, &value);
+        assert(value == 0);
+        delete_ciphered_int(ciphered_values[k]);
+    }
+    printf(" > encrypt_many test passed\n");
+
+    // Narrow integers, with the bits shared between threads
+    set_homomorph_threads(3);
+    for (uint32_t width = 1; width <= 64; width += 21) {
+        uint64_t value = ((uint64_t)rand() << 33) ^ (uint64_t)rand(), decrypted_value;
+        uint64_t mask = width == 64 ? UINT64_MAX : ((uint64_t)1 << width) - 1;
+        CipheredInt ciphered_value;
+        encrypt(value, width, ctx.pk, &ciphered_value);
+        assert(ciphered_value.width == width);
+        decrypt(&ciphered_value, ctx.sk, &decrypted_value);
+        assert(decrypted_value == (value & mask));
+        // Elements are read-only views of the integer, an accumulation moves them first
+        Polynomial_t element = ciphered_value.elements[0];
+        xor_into(&element, ciphered_value.elements[width-1]);
+        assert(element.coefficients != ciphered_value.elements[0].coefficients);
+        delete_polynom(element);
+        // Deleting a view does nothing
+        delete_polynom(ciphered_value.elements[0]);
+        delete_ciphered_int(ciphered_value);
+    }
+    set_homomorph_threads(1);
+    homomorph_clear(ctx);
+    printf(" > encrypt width test passed\n");
+
+    printf("encrypt_bits test passed\n");
+
+    /* --- Test DecryptContext ---*/
+    printf("DecryptContext test\n");
+    homomorph_init(d, dp, delta, tau, &ctx);
+    Polynomial_t ciphers[3*nb_test/100];
+    bool plain[3*nb_test/100], decrypted[3*nb_test/100];
+    const uint16_t nb_ciphers = sizeof(ciphers)/sizeof(ciphers[0]);
+    for (uint16_t i = 0; i < nb_ciphers; i++) {
+        Part part = random_part(tau);
+        plain[i] = rand() % 2;
+        encrypt_bit(plain[i], ctx.pk, part, &ciphers[i]);
+        delete_part(part);
+    }
+    // Products have twice the degree and exercise the whole reciprocal
+    for (uint16_t i = 2*nb_ciphers/3; i < nb_ciphers; i++) {
+        multiply_polynoms(ciphers[i], ciphers[i-1], &c);
+        delete_polynom(ciphers[i]);
+        ciphers[i] = c;
+    }
+    DecryptContext dctx;
+    decrypt_context_init(ctx.sk, 2*(d+dp), &dctx);
+    decrypt_bits(ciphers, nb_ciphers, dctx, decrypted);
+    for (uint16_t i = 0; i < nb_ciphers; i++) {
+        decrypt_bit(ciphers[i], ctx.sk, &y);
+        assert(decrypted[i] == y);
+        if (i < 2*nb_ciphers/3) assert(decrypted[i] == plain[i]);
+    }
+    decrypt_context_clear(dctx);
+    // Ciphertexts above the expected degree go through a full division
+    decrypt_context_init(ctx.sk, d+dp, &dctx);
+    decrypt_bits(ciphers, nb_ciphers, dctx, decrypted);
+    for (uint16_t i = 0; i < nb_ciphers; i++) {
+        decrypt_bit(ciphers[i], ctx.sk, &y);
+        assert(decrypted[i] == y);
+        delete_polynom(ciphers[i]);
+    }
+    decrypt_context_clear(dctx);
+    homomorph_clear(ctx);
+    printf("DecryptContext test passed\n");
+
+    /* --- Test Circuit ---*/
+    printf("Circuit test\n");
+    homomorph_init(d, dp, 16, tau, &ctx);
+    Circuit circuit;
+    circuit_init(&circuit);
+    gate_id_t in[8];
+    for (uint8_t i = 0; i < 8; i++) in[i] = circuit_input(&circuit);
+    // Constants are folded and equal gates are shared
+    assert(circuit_xor(&circuit, in[0], in[0]) == CIRCUIT_FALSE);
+    assert(circuit_and(&circuit, in[0], CIRCUIT_TRUE) == in[0]);
+    assert(circuit_and(&circuit, CIRCUIT_FALSE, in[0]) == CIRCUIT_FALSE);
+    assert(circuit_not(&circuit, circuit_not(&circuit, in[1])) == in[1]);
+    assert(circuit_xor(&circuit, in[0], in[1]) == circuit_xor(&circuit, in[1], in[0]));
+    gate_id_t chain = in[0];
+    for (uint8_t i = 1; i < 8; i++) chain = circuit_and(&circuit, chain, in[i]);
+    assert(circuit.gates[chain].level == 7);
+    circuit_output(&circuit, chain);
+    circuit_output(&circuit, circuit_xor(&circuit, circuit_or(&circuit, in[0], circuit_not(&circuit, in[2])), in[5]));
+    circuit_output(&circuit, circuit_not(&circuit, in[3]));
+    circuit_output(&circuit, in[4]);
+    circuit_output(&circuit, CIRCUIT_TRUE);
+    // The chain of products becomes a balanced tree
+    circuit_optimize(&circuit);
+    assert(circuit_depth(circuit) == 3);
+    for (uint8_t t = 0; t < 2; t++) {
+        bool plain[8];
+        Polynomial_t inputs[8], results[5];
+        for (uint8_t i = 0; i < 8; i++) plain[i] = t == 0 || rand() % 2;
+        encrypt_bits(plain, 8, ctx.pk, inputs);
+        circuit_evaluate(circuit, inputs, t == 0 ? 1 : 3, results);
+        bool all = true;
+        for (uint8_t i = 0; i < 8; i++) all = all && plain[i];
+        const bool expected[5] = {all, (plain[0] || !plain[2]) != plain[5], !plain[3], plain[4], true};
+        for (uint8_t o = 0; o < 5; o++) {
+            decrypt_bit(results[o], ctx.sk, &y);
+            assert(y == expected[o]);
+            delete_polynom(results[o]);
+        }
+        for (uint8_t i = 0; i < 8; i++) delete_polynom(inputs[i]);
+    }
+    // The balanced product of the 8 inputs, the OR of two of them and a constant
+    CipherStats fresh[8], estimated[5];
+    for (uint8_t i = 0; i < 8; i++) fresh[i] = (CipherStats){100, 10, 0};
+    CircuitCost cost;
+    circuit_estimate(circuit, fresh, estimated, &cost);
+    assert(estimated[0].degree == 800 && estimated[0].noise == 80 && estimated[0].depth == 3);
+    assert(estimated[1].noise == 20 && estimated[1].depth == 1);
+    assert(estimated[4].degree == 0 && estimated[4].noise == 0);
+    assert(cost.and_gates == 8 && cost.seconds > 0);
+    // The same circuit on a batch of instances, over several blocks
+    const uint64_t nb_instances = CIRCUIT_BATCH_BLOCK + 7;
+    bool* batch_bits = (bool*) malloc(8*nb_instances*sizeof(bool));
+    Polynomial_t* batch_inputs = (Polynomial_t*) malloc(8*nb_instances*sizeof(Polynomial_t));
+    Polynomial_t* batch_results = (Polynomial_t*) malloc(5*nb_instances*sizeof(Polynomial_t));
+    assert(batch_bits != NULL && batch_inputs != NULL && batch_results != NULL);
+    for (uint64_t i = 0; i < 8*nb_instances; i++) batch_bits[i] = rand() % 2;
+    encrypt_bits(batch_bits, 8*nb_instances, ctx.pk, batch_inputs);
+    circuit_evaluate_batch(circuit, batch_inputs, nb_instances, 3, batch_results);
+    for (uint64_t k = 0; k < nb_instances; k++) {
+        bool all = true;
+        for (uint8_t i = 0; i < 8; i++) all = all && batch_bits[i*nb_instances + k];
+        const bool expected[5] = {all, (batch_bits[k] || !batch_bits[2*nb_instances + k]) != batch_bits[5*nb_instances + k], !batch_bits[3*nb_instances + k], batch_bits[4*nb_instances + k], true};
+        for (uint8_t o = 0; o < 5; o++) {
+            decrypt_bit(batch_results[o*nb_instances + k], ctx.sk, &y);
+            assert(y == expected[o]);
+        }
+    }
+    for (uint64_t i = 0; i < 8*nb_instances; i++) delete_polynom(batch_inputs[i]);
+    for (uint64_t i = 0; i < 5*nb_instances; i++) delete_polynom(batch_results[i]);
+    free(batch_results);
+    free(batch_inputs);
+    free(batch_bits);
+    circuit_clear(circuit);
+    homomorph_clear(ctx);
+    printf("Circuit test passed\n");
+
+    /* --- Test ciphered_add ---*/
+    printf("ciphered_add test\n");
+    // The carry chain multiplies the noise 64 times, so it must stay far below the degree of the secret key
+    homomorph_init(d, dp, 16, tau, &ctx);
+    uint64_t a = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+    uint64_t b = ((uint64_t)rand() << 43) ^ ((uint64_t)rand() << 22) ^ (uint64_t)rand();
+    CipheredInt ca, cb, cs;
+    encrypt(a, 64, ctx.pk, &ca);
+    encrypt(b, 64, ctx.pk, &cb);
+    assert(ca.stats.noise == 17 && ca.stats.depth == 0);
+    const CipheredAdder adders[] = {CIPHERED_ADDER_RIPPLE, CIPHERED_ADDER_KOGGE_STONE, CIPHERED_ADDER_BRENT_KUNG, CIPHERED_ADDER_CIRCUIT};
+    const uint8_t nb_adders = sizeof(adders)/sizeof(adders[0]);
+    for (uint8_t t = 0; t < 2*nb_adders; t++) {
+        // Each adder on one thread, then on several
+        set_homomorph_threads(t < nb_adders ? 1 : 3);
+        CipherStats predicted;
+        CircuitCost cost;
+        estimate_add(ca, cb, adders[t % nb_adders], &predicted, &cost);
+        ciphered_add_with(ca, cb, adders[t % nb_adders], &cs);
+        uint64_t s = 0;
+        decrypt(&cs, ctx.sk, &s);
+        assert(s == a + b);
+        assert(cs.stats.noise == predicted.noise && cs.stats.depth == predicted.depth);
+        assert(cs.stats.degree <= predicted.degree);
+        assert(cost.and_gates > 0 && cost.word_products > 0 && cost.peak_bytes > 0 && cost.seconds > 0);
+        // The carry out of bit i is i+1 products deep with the ripple adder
+        if (adders[t % nb_adders] == CIPHERED_ADDER_RIPPLE) assert(cs.stats.depth == 63);
+        assert(noise_budget(cs.stats, ctx.sk) > 0);
+        delete_ciphered_int(cs);
+    }
+    set_homomorph_threads(1);
+    // Widths that are not powers of two
+    delete_ciphered_int(ca);
+    delete_ciphered_int(cb);
+    encrypt(a, 13, ctx.pk, &ca);
+    encrypt(b, 13, ctx.pk, &cb);
+    for (uint8_t t = 0; t < nb_adders; t++) {
+        ciphered_add_with(ca, cb, adders[t], &cs);
+        uint64_t s13 = 0;
+        decrypt(&cs, ctx.sk, &s13);
+        assert(s13 == ((a + b) & 0x1FFF));
+        // A sum added to a fresh integer: the stats of the two operands differ, and still match the estimate
+        CipheredInt cs2;
+        CipherStats predicted;
+        for (uint8_t u = 0; u < nb_adders; u++) {
+            estimate_add(cs, ca, adders[u], &predicted, NULL);
+            ciphered_add_with(cs, ca, adders[u], &cs2);
+            assert(cs2.stats.noise == predicted.noise && cs2.stats.depth == predicted.depth);
+            delete_ciphered_int(cs2);
+        }
+        delete_ciphered_int(cs);
+    }
+    delete_ciphered_int(ca);
+    delete_ciphered_int(cb);
+    // Batches, on one thread then on several
+    const uint64_t nb_pairs = 100;
+    uint64_t xs[nb_pairs], ys[nb_pairs], sums[nb_pairs];
+    for (uint64_t k = 0; k < nb_pairs; k++) {
+        xs[k] = rand() & 0xFFFF;
+        ys[k] = rand() & 0xFFFF;
+    }
+    CipheredBatch ba, bb, bs;
+    encrypt_batch(xs, nb_pairs, 16, ctx.pk, &ba);
+    encrypt_batch(ys, nb_pairs, 16, ctx.pk, &bb);
+    for (uint8_t t = 0; t < 2; t++) {
+        set_homomorph_threads(t == 0 ? 1 : 3);
+        ciphered_add_batch(ba, bb, &bs);
+        decrypt_batch(bs, ctx.sk, sums);
+        for (uint64_t k = 0; k < nb_pairs; k++) assert(sums[k] == ((xs[k] + ys[k]) & 0xFFFF));
+        assert(bs.stats.depth == 15 && bs.stats.noise > ba.stats.noise);
+        delete_ciphered_batch(bs);
+    }
+    set_homomorph_threads(1);
+    delete_ciphered_batch(ba);
+    delete_ciphered_batch(bb);
+    // Empty batches
+    encrypt_batch(xs, 0, 16, ctx.pk, &ba);
+    assert(ba.count == 0 && ba.width == 16);
+    decrypt_batch(ba, ctx.sk, sums);
+    delete_ciphered_batch(ba);
+    encrypt_batch(xs, nb_pairs, 0, ctx.pk, &ba);
+    assert(ba.count == nb_pairs && ba.width == 0);
+    decrypt_batch(ba, ctx.sk, sums);
+    for (uint64_t k = 0; k < nb_pairs; k++) assert(sums[k] == 0);
+    delete_ciphered_batch(ba);
+    homomorph_clear(ctx);
+    printf("ciphered_add test passed\n");
+
+    /* --- Test ciphered operations ---*/
+    printf("Ciphered operations test\n");
+    homomorph_init(d, dp, 4, tau, &ctx);
+    for (uint8_t t = 0; t < 2; t++) {
+        // Multiplication grows the degree fast, so the integers are narrow
+        const uint32_t width = 8;
+        set_homomorph_threads(t == 0 ? 1 : 3);
+        a = rand() & 0xFF;
+        b = t == 0 ? rand() & 0xFF : a;
+        encrypt(a, width, ctx.pk, &ca);
+        encrypt(b, width, ctx.pk, &cb);
+
+        uint64_t r;
+        ciphered_mul(ca, cb, &cs);
+        decrypt(&cs, ctx.sk, &r);
+        assert(r == ((a * b) & 0xFF));
+        // The Wallace tree and the prefix adder keep the depth logarithmic in the width
+        assert(cs.stats.depth <= 2*3 + 3);
+        delete_ciphered_int(cs);
+        if (t == 0) {
+            CipheredInt wa, wb;
+            uint64_t x = rand() & 0xFFFF, y = rand() & 0xFFFF;
+            encrypt(x, 16, ctx.pk, &wa);
+            encrypt(y, 16, ctx.pk, &wb);
+            ciphered_mul(wa, wb, &cs);
+            decrypt(&cs, ctx.sk, &r);
+            assert(r == ((x * y) & 0xFFFF));
+            assert(cs.stats.depth <= 2*4 + 3);
+            delete_ciphered_int(cs);
+            delete_ciphered_int(wa);
+            delete_ciphered_int(wb);
+        }
+
+        CipheredInt lt, eq;
+        ciphered_less_than(ca, cb, &lt);
+        decrypt(&lt, ctx.sk, &r);
+        assert(r == (a < b));
+        assert(lt.stats.depth == 4 && lt.stats.noise == 9*ca.stats.noise);
+        ciphered_equal(ca, cb, &eq);
+        decrypt(&eq, ctx.sk, &r);
+        assert(r == (a == b));
+        assert(eq.stats.depth == 3 && eq.stats.noise == 8*ca.stats.noise);
+
+        // min(a, b)
+        ciphered_select(lt, ca, cb, &cs);
+        decrypt(&cs, ctx.sk, &r);
+        assert(r == MIN(a, b));
+        delete_ciphered_int(cs);
+
+        delete_ciphered_int(lt);
+        delete_ciphered_int(eq);
+        delete_ciphered_int(ca);
+        delete_ciphered_int(cb);
+    }
+    set_homomorph_threads(1);
+    homomorph_clear(ctx);
+    printf("Ciphered operations test passed\n");
+
+    /* --- Test storage ---*/
+    printf("Storage test\n");
+    char path[] = "/tmp/bit_encryption_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    // Small noise, so that the sum below decrypts
+    homomorph_init(d, dp, 16, tau, &ctx);
+    write_context(path, ctx);
+    HomomFile file;
+    homom_file_open(path, &file);
+    assert(file.kind == HOMOM_FILE_CONTEXT);
+    HomomContext loaded;
+    read_context(file, &loaded);
+    assert(loaded.d == d && loaded.dp == dp && loaded.delta == 16 && loaded.tau == tau && loaded.pk.noise == ctx.pk.noise);
+    // The keys are aligned views on the file
+    assert(loaded.sk.size == 0 && (uintptr_t)loaded.sk.coefficients % HOMOM_FILE_ALIGNMENT == 0);
+    assert(loaded.sk.degree == ctx.sk.degree);
+    assert(memcmp(loaded.sk.coefficients, ctx.sk.coefficients, POL_WORDS(d + 1)*sizeof(pol_word_t)) == 0);
+    for (uint64_t k = 0; k < tau; k++) {
+        assert(loaded.pk.elements[k].size == 0 && loaded.pk.elements[k].degree == ctx.pk.elements[k].degree);
+        assert(memcmp(loaded.pk.elements[k].coefficients, ctx.pk.elements[k].coefficients, POL_WORDS(ctx.pk.elements[k].degree + 1)*sizeof(pol_word_t)) == 0);
+    }
+    uint64_t stored = 0;
+    a = rand() & 0xFFFF;
+    b = rand() & 0xFFFF;
+    encrypt(a, 16, loaded.pk, &ca);
+    decrypt(&ca, loaded.sk, &stored);
+    assert(stored == a);
+    encrypt(b, 16, ctx.pk, &cb);
+    ciphered_add(ca, cb, &cs);
+    homomorph_clear(loaded);
+    homom_file_close(file);
+
+    // Integers, with their stats
+    CipheredInt ints[3] = {ca, cb, cs}, loaded_ints[3];
+    const uint64_t expected_ints[3] = {a, b, (a + b) & 0xFFFF};
+    write_ciphered_ints(path, ints, 3);
+    homom_file_open(path, &file);
+    assert(ciphered_ints_count(file) == 3);
+    read_ciphered_ints(file, loaded_ints);
+    for (uint8_t k = 0; k < 3; k++) {
+        assert(loaded_ints[k].width == 16);
+        assert(loaded_ints[k].stats.noise == ints[k].stats.noise && loaded_ints[k].stats.depth == ints[k].stats.depth);
+        decrypt(&loaded_ints[k], ctx.sk, &stored);
+        assert(stored == expected_ints[k]);
+        delete_ciphered_int(loaded_ints[k]);
+        delete_ciphered_int(ints[k]);
+    }
+    homom_file_close(file);
+
+    // Batches
+    encrypt_batch(xs, nb_pairs, 16, ctx.pk, &ba);
+    write_ciphered_batch(path, ba);
+    homom_file_open(path, &file);
+    read_ciphered_batch(file, &bb);
+    assert(bb.width == 16 && bb.count == nb_pairs && bb.stats.noise == ba.stats.noise);
+    decrypt_batch(bb, ctx.sk, sums);
+    for (uint64_t k = 0; k < nb_pairs; k++) assert(sums[k] == xs[k]);
+    delete_ciphered_batch(bb);
+    delete_ciphered_batch(ba);
+    homom_file_close(file);
+
+    // Keys on their own
+    PubKey pk;
+    write_public_key(path, ctx.pk);
+    homom_file_open(path, &file);
+    read_public_key(file, &pk);
+    assert(pk.size == tau && pk.noise == ctx.pk.noise);
+    free(pk.elements);
+    homom_file_close(file);
+    SecKey sk;
+    write_secret_key(path, ctx.sk);
+    homom_file_open(path, &file);
+    read_secret_key(file, &sk);
+    encrypt(a, 16, ctx.pk, &ca);
+    decrypt(&ca, sk, &stored);
+    assert(stored == a);
+    delete_ciphered_int(ca);
+    homom_file_close(file);
+
+    printf("Storage test passed\n");
+
+    /* --- Test Stream ---*/
+    printf("Stream test\n");
+    // Two whole chunks and a partial one
+    const uint64_t n_plain = 2*STREAM_CHUNK_BYTES + 300;
+    uint8_t* bytes = (uint8_t*) malloc(n_plain);
+    uint8_t* round_trip = (uint8_t*) malloc(n_plain + 1);
+    assert(bytes != NULL && round_trip != NULL);
+    for (uint64_t k = 0; k < n_plain; k++) bytes[k] = rand() & 0xFF;
+    char plain_path[] = "/tmp/bit_encryption_XXXXXX";
+    int plain_fd = mkstemp(plain_path);
+    int cipher_fd = open(path, O_RDWR | O_TRUNC);
+    assert(plain_fd >= 0 && cipher_fd >= 0);
+    assert(write(plain_fd, bytes, n_plain) == (ssize_t)n_plain);
+
+    // The same seed gives the same stream
+    uint8_t* streams[2];
+    off_t stream_length[2];
+    for (uint8_t k = 0; k < 2; k++) {
+        pol_random_seed(seed);
+        assert(lseek(plain_fd, 0, SEEK_SET) == 0 && lseek(cipher_fd, 0, SEEK_SET) == 0 && ftruncate(cipher_fd, 0) == 0);
+        assert(encrypt_stream(fd_source(plain_fd), ctx.pk, fd_sink(cipher_fd)) == n_plain);
+        stream_length[k] = lseek(cipher_fd, 0, SEEK_CUR);
+        streams[k] = (uint8_t*) malloc(stream_length[k]);
+        assert(streams[k] != NULL && pread(cipher_fd, streams[k], stream_length[k], 0) == stream_length[k]);
+    }
+    assert(stream_length[0] == stream_length[1] && memcmp(streams[0], streams[1], stream_length[0]) == 0);
+    free(streams[0]);
+    free(streams[1]);
+
+    assert(lseek(plain_fd, 0, SEEK_SET) == 0 && lseek(cipher_fd, 0, SEEK_SET) == 0 && ftruncate(plain_fd, 0) == 0);
+    assert(decrypt_stream(fd_source(cipher_fd), ctx.sk, fd_sink(plain_fd)) == n_plain);
+    assert(lseek(plain_fd, 0, SEEK_SET) == 0);
+    assert(read(plain_fd, round_trip, n_plain + 1) == (ssize_t)n_plain);
+    assert(memcmp(bytes, round_trip, n_plain) == 0);
+
+    // An empty stream is its header and the end frame
+    assert(lseek(cipher_fd, 0, SEEK_SET) == 0 && ftruncate(cipher_fd, 0) == 0 && ftruncate(plain_fd, 0) == 0);
+    assert(encrypt_stream(fd_source(plain_fd), ctx.pk, fd_sink(cipher_fd)) == 0);
+    assert(lseek(cipher_fd, 0, SEEK_SET) == 0);
+    assert(decrypt_stream(fd_source(cipher_fd), ctx.sk, fd_sink(plain_fd)) == 0);
+
+    close(plain_fd);
+    close(cipher_fd);
+    remove(plain_path);
+    free(round_trip);
+    free(bytes);
+    printf("Stream test passed\n");
+
+    /* --- Test Service ---*/
+    printf("Service test\n");
+    EncryptService service;
+    encrypt_service_start(ctx.pk, 3, &service);
+    ServiceProducer producers[4];
+    pthread_t producer_threads[4];
+    for (uint8_t k = 0; k < 4; k++) {
+        producers[k] = (ServiceProducer){&service, ctx.sk, (uint64_t)rand()};
+        assert(pthread_create(&producer_threads[k], NULL, service_producer, &producers[k]) == 0);
+    }
+    for (uint8_t k = 0; k < 4; k++) pthread_join(producer_threads[k], NULL);
+    // Requests still queued are encrypted before the workers exit
+    uint64_t pending[3] = {1, 2, 3};
+    CipheredInt pending_ints[3];
+    EncryptRequest request = encrypt_request(pending, 3, 8, pending_ints);
+    encrypt_service_submit(&service, &request);
+    encrypt_service_stop(&service);
+    assert(request.done);
+    for (uint8_t k = 0; k < 3; k++) {
+        decrypt(&pending_ints[k], ctx.sk, &stored);
+        assert(stored == pending[k]);
+        delete_ciphered_int(pending_ints[k]);
+    }
+
+    remove(path);
+    homomorph_clear(ctx);
+    printf("Service test passed\n");
+
     return 0;
 }
\ No newline at end of file
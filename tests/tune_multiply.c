@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "polynom.h"
+#include "mul.h"
+
+
+/*
+ * Finds the multiplication thresholds of this machine and writes them as mul_params.h.
+ *
+ * Usage: tune_multiply [output]
+ * Without output, the header is printed on the standard output.
+ * Compile with the same flags as the library, then ship the header with the build of the machine.
+*/
+
+
+#define MAX_WORDS 131072
+#define REPETITIONS 5
+#define MIN_DURATION 0.02
+
+
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static pol_word_t random_word(void) {
+    return ((pol_word_t)rand() << 42) ^ ((pol_word_t)rand() << 21) ^ (pol_word_t)rand();
+}
+
+// Best time of a n words by n words product with the given thresholds
+static double time_product(uint64_t n, MulThresholds thresholds, const pol_word_t* a, const pol_word_t* b, pol_word_t* r) {
+    set_mul_thresholds(thresholds);
+    double best = 0;
+    for (uint8_t rep = 0; rep < REPETITIONS; rep++) {
+        uint64_t iterations = 0;
+        double start = now(), elapsed;
+        do {
+            mul_words(a, n, b, n, r);
+            iterations++;
+            elapsed = now() - start;
+        } while (elapsed < MIN_DURATION);
+        elapsed /= iterations;
+        if (rep == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// Smallest size from which one level of the next algorithm beats the current ones twice in a row
+// Sizes grow by 1/growth from one try to the next
+// level is 0 for Karatsuba, 1 for Toom-3 and 2 for FFT
+static uint64_t find_threshold(MulThresholds slow, uint8_t level, uint64_t from, uint64_t to, uint8_t growth, const pol_word_t* a, const pol_word_t* b, pol_word_t* r) {
+    uint64_t candidate = 0;
+    for (uint64_t n = from; n <= to; n += MAX(1, n/growth)) {
+        MulThresholds fast = slow;
+        if (level == 0) fast.karatsuba = n;
+        else if (level == 1) fast.toom3 = n;
+        else fast.fft = n;
+        double t_slow = time_product(n, slow, a, b, r);
+        double t_fast = time_product(n, fast, a, b, r);
+        fprintf(stderr, "  %5lu words: %10.0f ns / %10.0f ns\n", (unsigned long)n, t_slow*1e9, t_fast*1e9);
+        if (t_fast < t_slow) {
+            if (candidate) return candidate;
+            candidate = n;
+        }
+        else candidate = 0;
+    }
+    return candidate ? candidate : to;
+}
+
+
+int main(int argc, char** argv) {
+    srand(time(NULL));
+
+    pol_word_t* a = (pol_word_t*) malloc(MAX_WORDS*sizeof(pol_word_t));
+    pol_word_t* b = (pol_word_t*) malloc(MAX_WORDS*sizeof(pol_word_t));
+    pol_word_t* r = (pol_word_t*) calloc(2*MAX_WORDS, sizeof(pol_word_t));
+    if (a == NULL || b == NULL || r == NULL) return 1;
+    for (uint64_t i = 0; i < MAX_WORDS; i++) {
+        a[i] = random_word();
+        b[i] = random_word();
+    }
+
+    fprintf(stderr, "Karatsuba threshold (carry-less / Karatsuba)\n");
+    MulThresholds thresholds = {UINT64_MAX, UINT64_MAX, UINT64_MAX};
+    thresholds.karatsuba = find_threshold(thresholds, 0, 4, 2048, 8, a, b, r);
+
+    fprintf(stderr, "Toom-3 threshold (Karatsuba / Toom-3)\n");
+    thresholds.toom3 = find_threshold(thresholds, 1, MAX(3*thresholds.karatsuba/2, 6), 4096, 8, a, b, r);
+
+    fprintf(stderr, "FFT threshold (Toom-3 / FFT)\n");
+    thresholds.fft = find_threshold(thresholds, 2, MAX(4*thresholds.toom3, 1024), MAX_WORDS, 2, a, b, r);
+
+    free(a);
+    free(b);
+    free(r);
+
+    FILE* out = stdout;
+    if (argc > 1) {
+        out = fopen(argv[1], "w");
+        if (out == NULL) return 1;
+    }
+    fprintf(out, "#pragma once\n\n");
+    fprintf(out, "/**\n");
+    fprintf(out, " * @file mul_params.h\n");
+    fprintf(out, " * @brief Thresholds of the multiplication algorithms.\n");
+    fprintf(out, " *\n");
+    fprintf(out, " * Thresholds are numbers of words of the shorter operand from which an algorithm is used.\n");
+    fprintf(out, " * This file can be regenerated for a given machine with tests/tune_multiply.c.\n");
+    fprintf(out, " *\n");
+    fprintf(out, " * @see mul_words\n");
+    fprintf(out, "*/\n\n");
+    fprintf(out, "#ifndef KARATSUBA_THRESHOLD\n#define KARATSUBA_THRESHOLD %lu\n#endif\n\n", (unsigned long)thresholds.karatsuba);
+    fprintf(out, "#ifndef TOOM3_THRESHOLD\n#define TOOM3_THRESHOLD %lu\n#endif\n\n", (unsigned long)thresholds.toom3);
+    fprintf(out, "#ifndef FFT_THRESHOLD\n#define FFT_THRESHOLD %lu\n#endif\n", (unsigned long)thresholds.fft);
+    if (out != stdout) fclose(out);
+
+    return 0;
+}